@@ -1,51 +1,39 @@
 #include "OWLQN.h"
 
 #include "TerminationCriterion.h"
+#include "vecops.h"
 
 #include <vector>
-#include <deque>
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <chrono>
 
 using namespace std;
 
 double OptimizerState::dotProduct(const DblVec& a, const DblVec& b) {
-	double result = 0;
-	for (size_t i=0; i<a.size(); i++) {
-		result += a[i] * b[i];
-	}
-	return result;
+	return VecDot(a.data(), b.data(), a.size());
 }
 
 void OptimizerState::addMult(DblVec& a, const DblVec& b, double c) {
-	for (size_t i=0; i<a.size(); i++) {
-		a[i] += b[i] * c;
-	}
+	VecAddMult(a.data(), b.data(), c, a.size());
 }
 
 void OptimizerState::add(DblVec& a, const DblVec& b) {
-	for (size_t i=0; i<a.size(); i++) {
-		a[i] += b[i];
-	}
+	VecAdd(a.data(), b.data(), a.size());
 }
 
 void OptimizerState::addMultInto(DblVec& a, const DblVec& b, const DblVec& c, double d) {
-	for (size_t i=0; i<a.size(); i++) {
-		a[i] = b[i] + c[i] * d;
-	}
+	VecAddMultInto(a.data(), b.data(), c.data(), d, a.size());
 }
 
 void OptimizerState::scale(DblVec& a, double b) {
-	for (size_t i=0; i<a.size(); i++) {
-		a[i] *= b;
-	}
+	VecScale(a.data(), b, a.size());
 }
 
 void OptimizerState::scaleInto(DblVec& a, const DblVec& b, double c) {
-	for (size_t i=0; i<a.size(); i++) {
-		a[i] = b[i] * c;
-	}
+	VecScaleInto(a.data(), b.data(), c, a.size());
 }
 
 //OWLQN
@@ -80,39 +68,211 @@ void OptimizerState::MakeSteepestDescDir() {
 	}
 
 	//记录当前的最速下降方向
-	steepestDescDir = dir;
+	if (activeSet) {
+		UpdateActive();
+		for (size_t k = 0; k < active.size(); k++) steepestDescDir[active[k]] = dir[active[k]];
+	} else {
+		steepestDescDir = dir;
+	}
+}
+
+//重新收集活动维度：x非零或最速下降方向非零的维度
+void OptimizerState::UpdateActive() {
+	prevActive.swap(active);
+	active.clear();
+	for (size_t i = 0; i < dim; i++) {
+		if (x[i] != 0 || dir[i] != 0) active.push_back(i);
+	}
+	haveActive = true;
+}
+
+//sum(|v[i]|)；active set模式下v在活动维度之外为0
+double OptimizerState::AbsSum(const DblVec& v) const {
+	if (!haveActive) return VecAbsSum(v.data(), dim);
+	double sum = 0;
+	for (size_t k = 0; k < active.size(); k++) sum += fabs(v[active[k]]);
+	return sum;
+}
+
+//按块遍历dir时每块的长度，一块dir在整个块的计算中都留在L1 cache里
+static const size_t kHistBlock = 1024;
+
+//记忆项按double或float存储时的向量运算，都在double中累加
+static double histDot(const double* a, const double* b, size_t n) { return VecDot(a, b, n); }
+static double histDot(const float* a, const double* b, size_t n) { return VecDotFloat(a, b, n); }
+static double histDot(const float* a, const float* b, size_t n) { return VecDotFloats(a, b, n); }
+static void histAddMult(double* a, const double* b, double c, size_t n) { VecAddMult(a, b, c, n); }
+static void histAddMult(double* a, const float* b, double c, size_t n) { VecAddMultFloat(a, b, c, n); }
+//a = b - c
+static void histSub(double* a, const double* b, const double* c, size_t n) { VecAddMultInto(a, b, c, -1, n); }
+static void histSub(float* a, const double* b, const double* c, size_t n) { VecSubIntoFloat(a, b, c, n); }
+
+//按下标列表idx计算的内积和a += b * c，用于active set模式
+template <class A, class B>
+static double gatherDot(const A* a, const B* b, const std::vector<size_t>& idx) {
+	double s0 = 0, s1 = 0;
+	size_t k = 0, n = idx.size();
+	for (; k + 2 <= n; k += 2) {
+		s0 += (double)a[idx[k]] * b[idx[k]];
+		s1 += (double)a[idx[k + 1]] * b[idx[k + 1]];
+	}
+	if (k < n) s0 += (double)a[idx[k]] * b[idx[k]];
+	return s0 + s1;
+}
+
+template <class T>
+static void gatherAddMult(double* a, const T* b, double c, const std::vector<size_t>& idx) {
+	for (size_t k = 0; k < idx.size(); k++) a[idx[k]] += b[idx[k]] * c;
 }
 
 //lgfgs
 //计算下降方向dir（参数的二阶梯度）
-//lbfgs中的two loop，用过去m次的信息来近似计算Hessian矩阵的逆(进而得到当前的下降方向)
 void OptimizerState::MapDirByInverseHessian() {
-	int count = (int)sList.size(); //lbfgs记忆的过去的迭代结果的个数m
+	PhaseTimer timer(Phase(&IterationStats::mapDir));
+	if (histCount == 0) return;
+	//估计读写的字节数：compact模式两次分块遍历记忆项，dir的一块留在cache中；
+	//否则每个记忆项的内积读一遍记忆项和dir，加法读一遍记忆项、读写一遍dir
+	double n = (double)WorkingDim(), e = floatHistory ? sizeof(float) : sizeof(double);
+	if (compact) Touch(histCount * 4 * e * n + 24 * n);
+	else Touch(histCount * (4 * e + 48) * n + (e + 16) * n);
+	if (activeSet) {
+		if (floatHistory) TwoLoopActive(sMatF, yMatF);
+		else TwoLoopActive(sMat, yMat);
+	} else if (floatHistory) {
+		if (compact) TwoLoopCompact(sMatF, yMatF);
+		else TwoLoop(sMatF, yMatF);
+	} else {
+		if (compact) TwoLoopCompact(sMat, yMat);
+		else TwoLoop(sMat, yMat);
+	}
+}
+
+//lbfgs中的two loop，用过去m次的信息来近似计算Hessian矩阵的逆(进而得到当前的下降方向)
+template <class T>
+void OptimizerState::TwoLoop(const T* S, const T* Y) {
+	int count = histCount; //lbfgs记忆的过去的迭代结果的个数m
+
+	//第一个for loop
+	for (int i = count - 1; i >= 0; i--) {
+		alphas[i] = -histDot(Row(S, i), dir.data(), dim) / roList[HistRow(i)]; //不同于论文中的地方是，这里ruo的计算未取倒数，所以这里是除法；另外，这里的alpha取了负值
+		histAddMult(dir.data(), Row(Y, i), alphas[i], dim);
+	}
+
+	//根据lastY和lastRuo 计算了一个值，对应论文中的rj，这里保存了roList，所以使用roList[[count - 1]简化了计算
+	const T* lastY = Row(Y, count - 1);
+	double yDotY = histDot(lastY, lastY, dim);
+	double scalar = roList[HistRow(count - 1)] / yDotY;
+	scale(dir, scalar);
+
+	//第二个for loop
+	for (int i = 0; i < count; i++) {
+		double beta = histDot(Row(Y, i), dir.data(), dim) / roList[HistRow(i)];//不同于论文中的地方是，这里ruo的计算未取倒数，所以这里是除法
+		histAddMult(dir.data(), Row(S, i), -alphas[i] - beta, dim);
+	}
+}
+
+//active set模式的two loop：s、y都投影到活动维度上，rou也用投影后的s、y重新计算
+//投影后s·y不一定为正，这样的记忆项跳过；没有可用的记忆项时dir保持为最速下降方向
+template <class T>
+void OptimizerState::TwoLoopActive(const T* S, const T* Y) {
+	int count = histCount;
+	double* ro = scratch;
+	int newest = -1;
+	for (int i = 0; i < count; i++) {
+		ro[i] = gatherDot(Row(S, i), Row(Y, i), active);
+		if (ro[i] > 0) newest = i;
+	}
+	if (newest < 0) return;
+
+	double* d = dir.data();
+	for (int i = count - 1; i >= 0; i--) {
+		if (ro[i] <= 0) continue;
+		alphas[i] = -gatherDot(Row(S, i), d, active) / ro[i];
+		gatherAddMult(d, Row(Y, i), alphas[i], active);
+	}
 
-	if (count != 0) {
-		//第一个for loop
-		for (int i = count - 1; i >= 0; i--) {
-			alphas[i] = -dotProduct(*sList[i], dir) / roList[i]; //不同于论文中的地方是，这里ruo的计算未取倒数，所以这里是除法；另外，这里的alpha取了负值
-			addMult(dir, *yList[i], alphas[i]);
+	const T* lastY = Row(Y, newest);
+	double scalar = ro[newest] / gatherDot(lastY, lastY, active);
+	for (size_t k = 0; k < active.size(); k++) d[active[k]] *= scalar;
+
+	for (int i = 0; i < count; i++) {
+		if (ro[i] <= 0) continue;
+		double beta = gatherDot(Row(Y, i), d, active) / ro[i];
+		gatherAddMult(d, Row(S, i), -alphas[i] - beta, active);
+	}
+}
+
+//compact表示的two loop：结果与上面的two loop相同
+//把dir写成 cq * q + sum(cs_i * s_i) + sum(cy_i * y_i)，q为最速下降方向
+//两个loop中需要的 s_i·dir 和 y_i·dir 都可以由 s_i·q、y_i·q 和Gram矩阵算出，所以只需一次分块遍历算内积、一次分块遍历合成dir
+template <class T>
+void OptimizerState::TwoLoopCompact(const T* S, const T* Y) {
+	int count = histCount;
+	double *sq = scratch, *yq = scratch + m, *cs = scratch + 2 * m, *cy = scratch + 3 * m;
+	for (int i = 0; i < count; i++) {
+		sq[i] = yq[i] = cs[i] = cy[i] = 0;
+	}
+
+	//第一次遍历：sq[i] = s_i·q，yq[i] = y_i·q
+	for (size_t b = 0; b < dim; b += kHistBlock) {
+		size_t len = min(kHistBlock, dim - b);
+		for (int i = 0; i < count; i++) {
+			sq[i] += histDot(Row(S, i) + b, dir.data() + b, len);
+			yq[i] += histDot(Row(Y, i) + b, dir.data() + b, len);
+		}
+	}
+
+	//第一个for loop：s_i·dir = s_i·q + sum_{j>i}(cy_j * s_i·y_j)
+	for (int i = count - 1; i >= 0; i--) {
+		int ri = HistRow(i);
+		double sDir = sq[i];
+		for (int j = i + 1; j < count; j++) {
+			sDir += cy[j] * syGram[ri * m + HistRow(j)];
 		}
+		alphas[i] = -sDir / roList[ri];
+		cy[i] = alphas[i];
+	}
 
-		//根据lastY和lastRuo 计算了一个值，对应论文中的rj，这里保存了roList，所以使用roList[[count - 1]简化了计算
-		const DblVec& lastY = *yList[count - 1];
-		double yDotY = dotProduct(lastY, lastY);
-		double scalar = roList[count - 1] / yDotY;
-		scale(dir, scalar);
+	//乘以scalar
+	int last = HistRow(count - 1);
+	double cq = roList[last] / yyGram[last * m + last];
+	for (int j = 0; j < count; j++) cy[j] *= cq;
+
+	//第二个for loop：y_i·dir = cq * y_i·q + sum_j(cy_j * y_i·y_j) + sum_{j<i}(cs_j * s_j·y_i)
+	for (int i = 0; i < count; i++) {
+		int ri = HistRow(i);
+		double yDir = cq * yq[i];
+		for (int j = 0; j < count; j++) {
+			yDir += cy[j] * yyGram[ri * m + HistRow(j)];
+		}
+		for (int j = 0; j < i; j++) {
+			yDir += cs[j] * syGram[HistRow(j) * m + ri];
+		}
+		double beta = yDir / roList[ri];
+		cs[i] = -alphas[i] - beta;
+	}
 
-		//第二个for loop
+	//第二次遍历：合成dir
+	for (size_t b = 0; b < dim; b += kHistBlock) {
+		size_t len = min(kHistBlock, dim - b);
+		double* d = dir.data() + b;
+		VecScale(d, cq, len);
 		for (int i = 0; i < count; i++) {
-			double beta = dotProduct(*yList[i], dir) / roList[i];//不同于论文中的地方是，这里ruo的计算未取倒数，所以这里是除法
-			addMult(dir, *sList[i], -alphas[i] - beta);
+			histAddMult(d, Row(S, i) + b, cs[i], len);
+			histAddMult(d, Row(Y, i) + b, cy[i], len);
 		}
 	}
 }
 
 void OptimizerState::FixDirSigns() {
 	//如果存在l1正则化项
-	if (l1weight > 0) {
+	if (l1weight > 0 && activeSet) {
+		//活动维度之外dir已经是0，只需检查活动维度
+		for (size_t k = 0; k < active.size(); k++) {
+			size_t i = active[k];
+			if (dir[i] * steepestDescDir[i] <= 0) dir[i] = 0;
+		}
+	} else if (l1weight > 0) {
 		//dim是参数（特征）的维度数
 		for (size_t i = 0; i<dim; i++) {
 			//dir[i]与原来的虚梯度计算出来的方向不同的维度，置零
@@ -124,9 +284,13 @@ void OptimizerState::FixDirSigns() {
 }
 
 void OptimizerState::UpdateDir() {
+	PhaseTimer timer(Phase(&IterationStats::updateDir));
 	MakeSteepestDescDir();
+	//读x、grad，写dir、steepestDescDir；active set模式下还要扫描一遍x和dir
+	Touch(dim * (activeSet ? 48.0 : 32.0));
 	MapDirByInverseHessian();
 	FixDirSigns();
+	if (l1weight > 0) Touch(WorkingDim() * 16.0);
 
 #ifdef _DEBUG
 	TestDirDeriv();
@@ -146,10 +310,13 @@ void OptimizerState::TestDirDeriv() {
 //计算的是线性查找更新步长的一部分：判断停止查找的条件中的下降方向*虚梯度[未乘以alpha]
 double OptimizerState::DirDeriv() const {
 	if (l1weight == 0) {
-		return dotProduct(dir, grad);
+		return haveActive ? gatherDot(dir.data(), grad.data(), active) : dotProduct(dir, grad);
 	} else {
 		double val = 0.0;
-		for (size_t i = 0; i < dim; i++) {
+		//active set模式下只遍历活动维度
+		size_t n = haveActive ? active.size() : dim;
+		for (size_t k = 0; k < n; k++) {
+			size_t i = haveActive ? active[k] : k;
 			//同MakeSteepestDescDir中虚梯度的计算
 			if (dir[i] != 0) { 
 				if (x[i] < 0) {
@@ -169,7 +336,22 @@ double OptimizerState::DirDeriv() const {
 }
 
 //根据x，dir，alpha获得新的查找点newX
-void OptimizerState::GetNextPoint(double alpha) {
+//返回是否有维度因为跨了象限被置零，这时newX不等于x + alpha * dir
+bool OptimizerState::GetNextPoint(double alpha) {
+	bool clipped = false;
+	if (haveActive) {
+		//活动维度之外newX与x相同（都是0）
+		for (size_t k = 0; k < active.size(); k++) {
+			size_t i = active[k];
+			newX[i] = x[i] + dir[i] * alpha;
+			if (l1weight > 0 && x[i] * newX[i] < 0.0) {
+				newX[i] = 0.0;
+				clipped = true;
+			}
+		}
+		return clipped;
+	}
+
 	//获得新的查找点newX
 	addMultInto(newX, x, dir, alpha);
 	if (l1weight > 0) {
@@ -177,113 +359,201 @@ void OptimizerState::GetNextPoint(double alpha) {
 			//如果查找点跨了象限，置零
 			if (x[i] * newX[i] < 0.0) {
 				newX[i] = 0.0;
+				clipped = true;
 			}
 		}
 	}
+	return clipped;
 }
 
 double OptimizerState::EvalL1() {
-	//根据新的X（即参数）来计算新的梯度newGrad、新的损失值loss
-	double val = func.Eval(newX, newGrad);
+	PhaseTimer timer(Phase(&IterationStats::eval));
+	//根据新的X（即参数）来计算新的梯度newGrad、新的损失值loss；随机模式下只用当前batch中的样本
+	double val = batch.empty() ? func.Eval(newX, newGrad) : stochFunc->EvalBatch(batch, newX, newGrad);
 	//如果l1正则化项的参数为正，损失加上l1正则化项的部分
 	if (l1weight > 0) {
-		for (size_t i=0; i<dim; i++) {
-			val += fabs(newX[i]) * l1weight;
-		}
+		val += AbsSum(newX) * l1weight;
 	}
 
 	//返回损失值
 	return val;
 }
 
-//回退的线性查找：找更新的步长（学习率）alpha
-void OptimizerState::BackTrackingLineSearch() {
+//线性查找：找更新的步长（学习率）alpha，具体的查找方法由lineSearch决定
+//方向为0（虚梯度为0，x已经是最优解，例如l1weight不小于lambdaMax时的x = 0）时不查找，返回false
+bool OptimizerState::FindStep() {
 	//计算的是线性查找更新步长的一部分：判断停止查找的条件中的下降方向*虚梯度[未乘以alpha]
-	double origDirDeriv = DirDeriv();
+	origDirDeriv = DirDeriv();
+	if (origDirDeriv == 0 && AbsSum(dir) == 0) {
+		newX = x;
+		lastAlpha = 0;
+		lastEvals = 0;
+		return false;
+	}
 	// if a non-descent direction is chosen, the line search will break anyway, so throw here
 	// The most likely reason for this is a bug in your function's gradient computation
 	if (origDirDeriv >= 0) {
 		cerr << "L-BFGS chose a non-descent direction: check your gradient!" << endl;
 		exit(1);
 	}
+	origValue = value; //记录之前的损失值
 
-	double alpha = 1.0;
-	double backoff = 0.5;
-
-	//第一次迭代时
-	if (iter == 1) {
-		//alpha = 0.1;
-		//backoff = 0.5;
-		//计算dir的绝对值
-		double normDir = sqrt(dotProduct(dir, dir));
-		//将alpha、backoff设置成新的特定值
-		alpha = (1 / normDir);
-		backoff = 0.1;
+	//active set模式：newX在上一次迭代的活动维度上还是上一次的x，先与x同步
+	if (haveActive) {
+		for (size_t k = 0; k < prevActive.size(); k++) newX[prevActive[k]] = x[prevActive[k]];
 	}
 
-	const double c1 = 1e-4;
-	double oldValue = value; //记录之前的损失值
+	//使用缓存时，没有维度被置零的尝试点只计算损失，接受步长后再计算梯度
+	searchCached = (lsFunc != NULL && batch.empty());
+	if (searchCached) lsFunc->BeginLineSearch(x, dir);
 
-	while (true) {
-		//根据x，dir，alpha获得新的查找点newX
-		GetNextPoint(alpha);
-		//根据newX（即参数）来计算新的梯度newGrad、新的损失值value
-		value = EvalL1();
+	PhaseTimer timer(Phase(&IterationStats::lineSearch));
+	lastEvals = lineSearch->Search(*this);
+	return true;
+}
 
+//尝试步长alpha：根据x，dir，alpha获得新的查找点newX，计算newX处的目标函数值
+double OptimizerState::TryStep(double alpha, bool needGrad) {
+	bool clipped = GetNextPoint(alpha);
+	lastAlpha = alpha;
+	lastCached = searchCached && !clipped && !needGrad;
+	//GetNextPoint读x、dir，写newX；有l1正则化项时再读一遍newX
+	Touch(WorkingDim() * (l1weight > 0 ? 32.0 : 24.0));
+	//根据newX（即参数）来计算新的梯度newGrad、新的损失值
+	return lastCached ? EvalL1AtStep(alpha) : EvalL1();
+}
 
-		//计算的是线性查找更新步长的停止查找条件
-		if (value <= oldValue + c1 * origDirDeriv * alpha) break;
+//接受步长alpha：保证newX、newGrad是alpha对应的点和梯度
+void OptimizerState::TakeStep(double alpha, double stepValue) {
+	if (alpha != lastAlpha) stepValue = TryStep(alpha, false);
+	if (lastCached) {
+		PhaseTimer timer(Phase(&IterationStats::cachedEval));
+		lsFunc->AcceptStep(alpha, newGrad);
+	}
+	value = stepValue;
+}
 
-		if (!quiet) cout << "." << flush;
+//用线性查找的缓存计算newX = x + alpha * dir处的损失，不计算梯度
+double OptimizerState::EvalL1AtStep(double alpha) {
+	PhaseTimer timer(Phase(&IterationStats::cachedEval));
+	double val = lsFunc->EvalAtStep(alpha);
+	if (l1weight > 0) {
+		val += AbsSum(newX) * l1weight;
+	}
+	return val;
+}
 
-		//更新alpha：如果不符合停止查找条件，步长回退，即beta^n
-		alpha *= backoff;
+//从样本的随机排列中取出下一个batch，排列中剩下的样本不够时重新打乱
+//batch大小达到全部样本时清空batch，之后一直使用全部样本
+void OptimizerState::SampleBatch() {
+	size_t n = stochFunc->NumInstances(), size = (size_t)batchSize;
+	if (size >= n) {
+		batch.clear();
+		stochFunc = NULL;
+		return;
+	}
+	if (perm.empty()) {
+		perm.resize(n);
+		for (size_t i = 0; i < n; i++) perm[i] = i;
+		permPos = n;
+	}
+	if (n - permPos < size) {
+		shuffle(perm.begin(), perm.end(), rng);
+		permPos = 0;
 	}
+	batch.assign(perm.begin() + permPos, perm.begin() + permPos + size);
+	permPos += size;
+	//按样本顺序访问数据
+	sort(batch.begin(), batch.end());
+}
 
-	if (!quiet) cout << endl;
+//随机模式下一次迭代（Shift之后）换一个更大的batch，并在新的batch上重新计算当前点的损失和梯度
+//返回是否仍在使用batch
+bool OptimizerState::NextBatch() {
+	batchSize *= batchGrowth;
+	SampleBatch();
+	newX = x;
+	value = EvalL1();
+	grad = newGrad;
+	return !batch.empty();
 }
 
-//优化的状态迁移：更新lbfgs中两个记忆列表
-void OptimizerState::Shift() {
-	DblVec *nextS = NULL, *nextY = NULL;
-
-	//lbfgs中记忆项的个数
-	int listSize = (int)sList.size();
-
-	//刚开始时，记忆项不到m，所以申请新的记忆项空间
-	if (listSize < m) {
-		try {
-			nextS = new vector<double>(dim);
-			nextY = new vector<double>(dim);
-		} catch (bad_alloc) {
-			m = listSize; //未分配的可用内存不够时，就使用当前能够分配的记忆项的数量作为m
-			if (nextS != NULL) { //如果给S分配成功了，但Y未分配成功，就把S释放掉
-				delete nextS;
-				nextS = NULL;
-			}
-		}
+size_t OptimizerState::HistoryBytes(size_t dim, int m, bool compact, bool floatHistory) {
+	if (m <= 0) return 0;
+	size_t bytes = 2 * Arena::Bytes((size_t)m * dim, floatHistory ? sizeof(float) : sizeof(double)) + 2 * Arena::Bytes(m);
+	bytes += Arena::Bytes(4 * (size_t)m);
+	if (compact) bytes += 2 * Arena::Bytes((size_t)m * m);
+	return bytes;
+}
+
+size_t OptimizerState::MemoryBytes(size_t dim, int m, bool compact, bool floatHistory) {
+	return 5 * dim * sizeof(double) + HistoryBytes(dim, m, compact, floatHistory);
+}
+
+//从arena中切出记忆项的环形缓冲和two-loop用的数组，大小与HistoryBytes一致
+void OptimizerState::AllocateHistory() {
+	sMat = yMat = NULL;
+	sMatF = yMatF = NULL;
+	if (floatHistory) {
+		sMatF = arena.Floats((size_t)m * dim);
+		yMatF = arena.Floats((size_t)m * dim);
+	} else {
+		sMat = arena.Doubles((size_t)m * dim);
+		yMat = arena.Doubles((size_t)m * dim);
 	}
+	roList = arena.Doubles(m);
+	alphas = arena.Doubles(m);
+	scratch = arena.Doubles(4 * (size_t)m);
+	syGram = yyGram = NULL;
+	if (compact) {
+		syGram = arena.Doubles((size_t)m * m);
+		yyGram = arena.Doubles((size_t)m * m);
+	}
+}
 
-	//如果未分配新的S和Y，即已经有m个记忆项了
-	if (nextS == NULL) {
-		nextS = sList.front();
-		sList.pop_front(); //弹出最老的s
-		nextY = yList.front();
-		yList.pop_front(); //弹出最老的y
-		roList.pop_front(); //弹出最老的rou
+//新的记忆项写入最新的一行后，更新Gram矩阵中与它相关的行和列：一次分块遍历S和Y
+template <class T>
+void OptimizerState::UpdateGram(const T* S, const T* Y) {
+	int count = histCount, newest = HistRow(count - 1);
+	const T* s = Row(S, count - 1);
+	const T* y = Row(Y, count - 1);
+	double *sy = scratch, *ys = scratch + m, *yy = scratch + 2 * m;
+	for (int j = 0; j < count; j++) {
+		sy[j] = ys[j] = yy[j] = 0;
 	}
 
-	//计算参数和梯度的差值，存入*nextS和nextY
-	addMultInto(*nextS, newX, x, -1);
-	addMultInto(*nextY, newGrad, grad, -1);
+	for (size_t b = 0; b < dim; b += kHistBlock) {
+		size_t len = min(kHistBlock, dim - b);
+		for (int j = 0; j < count; j++) {
+			sy[j] += histDot(s + b, Row(Y, j) + b, len);
+			ys[j] += histDot(Row(S, j) + b, y + b, len);
+			yy[j] += histDot(y + b, Row(Y, j) + b, len);
+		}
+	}
 
-	//计算新的ruo，不同于论文中的地方是，这里未取倒数
-	double ro = dotProduct(*nextS, *nextY); 
+	for (int j = 0; j < count; j++) {
+		int rj = HistRow(j);
+		syGram[newest * m + rj] = sy[j];
+		syGram[rj * m + newest] = ys[j];
+		yyGram[newest * m + rj] = yy[j];
+		yyGram[rj * m + newest] = yy[j];
+	}
+}
 
-	//保存新的记忆项
-	sList.push_back(nextS);
-	yList.push_back(nextY);
-	roList.push_back(ro);
+//优化的状态迁移：更新lbfgs中两个记忆列表
+void OptimizerState::Shift() {
+	PhaseTimer timer(Phase(&IterationStats::shift));
+	//新的记忆项读newX、x、newGrad、grad，写s、y，再读一遍s、y算rou；compact模式下更新Gram矩阵还要读一遍所有记忆项
+	double e = floatHistory ? sizeof(float) : sizeof(double);
+	Touch(dim * (32 + 4 * e) + (compact ? min(histCount + 1, m) * 2 * e * dim : 0));
+	//已经有m个记忆项时，最老的一行被新的记忆项覆盖
+	if (histCount == m) {
+		histStart = (histStart + 1) % m;
+		histCount--;
+	}
+	histCount++;
+	if (floatHistory) StoreHistory(sMatF, yMatF);
+	else StoreHistory(sMat, yMat);
 
 	//将新的参数和梯度设为当前的参数和梯度
 	x.swap(newX);
@@ -293,31 +563,211 @@ void OptimizerState::Shift() {
 	iter++;
 }
 
+//把新的记忆项写入最新的一行
+template <class T>
+void OptimizerState::StoreHistory(T* S, T* Y) {
+	T* nextS = Row(S, histCount - 1);
+	T* nextY = Row(Y, histCount - 1);
+
+	//计算参数和梯度的差值，存入nextS和nextY
+	histSub(nextS, newX.data(), x.data(), dim);
+	histSub(nextY, newGrad.data(), grad.data(), dim);
+
+	//计算新的ruo，不同于论文中的地方是，这里未取倒数；按存储的（舍入后的）s、y计算，与two-loop中使用的一致
+	roList[HistRow(histCount - 1)] = histDot(nextS, nextY, dim);
+	if (compact) UpdateGram(S, Y);
+}
+
+//把记忆项按从老到新的顺序复制到history中
+void OptimizerState::SaveHistory(LbfgsHistory& h) const {
+	h.dim = dim;
+	h.count = histCount;
+	h.isFloat = floatHistory;
+	h.ro.resize(histCount);
+	for (int i = 0; i < histCount; i++) h.ro[i] = roList[HistRow(i)];
+	if (floatHistory) {
+		CopyRows(sMatF, yMatF, h.sF, h.yF);
+		h.s.clear();
+		h.y.clear();
+	} else {
+		CopyRows(sMat, yMat, h.s, h.y);
+		h.sF.clear();
+		h.yF.clear();
+	}
+}
+
+template <class T>
+void OptimizerState::CopyRows(const T* S, const T* Y, std::vector<T>& s, std::vector<T>& y) const {
+	s.resize((size_t)histCount * dim);
+	y.resize((size_t)histCount * dim);
+	for (int i = 0; i < histCount; i++) {
+		copy(Row(S, i), Row(S, i) + dim, s.begin() + (size_t)i * dim);
+		copy(Row(Y, i), Row(Y, i) + dim, y.begin() + (size_t)i * dim);
+	}
+}
+
+//用history中最新的（最多m个）记忆项作为初始的记忆项
+void OptimizerState::LoadHistory(const LbfgsHistory& h) {
+	if (h.dim != dim || h.isFloat != floatHistory || h.count == 0) return;
+	int first = max(0, h.count - m);
+	if (floatHistory) PutRows(sMatF, yMatF, h.sF, h.yF, h.ro, first, h.count);
+	else PutRows(sMat, yMat, h.s, h.y, h.ro, first, h.count);
+}
+
+template <class T>
+void OptimizerState::PutRows(T* S, T* Y, const std::vector<T>& s, const std::vector<T>& y, const std::vector<double>& ro, int first, int count) {
+	histStart = 0;
+	histCount = 0;
+	for (int k = first; k < count; k++) {
+		histCount++;
+		copy(s.begin() + (size_t)k * dim, s.begin() + (size_t)(k + 1) * dim, Row(S, histCount - 1));
+		copy(y.begin() + (size_t)k * dim, y.begin() + (size_t)(k + 1) * dim, Row(Y, histCount - 1));
+		roList[HistRow(histCount - 1)] = ro[k];
+		if (compact) UpdateGram(S, Y);
+	}
+}
+
+//point处的非零维度数和虚梯度的2范数：x非零的维度为梯度加上l1weight * sign(x)，
+//x为0的维度取左右导数中与0同号的一个（都不与0同号时为0），与MakeSteepestDescDir中的方向相反
+void OptimizerState::MeasureOptimality(const DblVec& point, const DblVec& gradient) {
+	size_t nonZeros = 0;
+	double sum = 0;
+	for (size_t i = 0; i < dim; i++) {
+		double g = gradient[i];
+		if (point[i] != 0) {
+			nonZeros++;
+			g += point[i] < 0 ? -l1weight : l1weight;
+		} else if (g < -l1weight) {
+			g += l1weight;
+		} else if (g > l1weight) {
+			g -= l1weight;
+		} else {
+			g = 0;
+		}
+		sum += g * g;
+	}
+	stats->nonZeros = nonZeros;
+	stats->residual = sqrt(sum);
+}
+
 //寻找最小损失的过程
 //输入依次为：优化问题、初始参数、收敛时的参数（输出的结果）、l1正则化项的参数、允许的误差、limit-memory中记忆的迭代步数的数量
-void OWLQN::Minimize(DifferentiableFunction& function, const DblVec& initial, DblVec& minimum, double l1weight, double tol, int m) const {
+void OWLQN::Minimize(DifferentiableFunction& function, const DblVec& initial, DblVec& minimum, double l1weight, double tol, int m,
+	LbfgsHistory* history) const {
+	StochasticDifferentiableFunction* stochFunc = NULL;
+	if (initialBatch > 0) {
+		stochFunc = dynamic_cast<StochasticDifferentiableFunction*>(&function);
+		if (stochFunc == NULL) {
+			cerr << "mini-batch mode requires a function that can be evaluated on a subset of instances" << endl;
+			exit(1);
+		}
+		//growth不大于1时batch永远达不到全部样本，不会开始判断终止条件
+		if (!(batchGrowth > 1)) {
+			cerr << "mini-batch growth factor must be greater than 1" << endl;
+			exit(1);
+		}
+	}
+
+	if (activeSet && compactHistory) {
+		cerr << "active set mode cannot be combined with the compact L-BFGS representation" << endl;
+		exit(1);
+	}
+
+	//有内存上限时，在分配之前选定m
+	bool limited = false;
+	if (memoryBudget > 0) {
+		while (m > 0 && OptimizerState::MemoryBytes(initial.size(), m, compactHistory, floatHistory) > memoryBudget) {
+			m--;
+			limited = true;
+		}
+		if (m == 0) {
+			cerr << "memory budget of " << memoryBudget << " bytes is too small for " << initial.size() << " variables: need at least "
+				<< OptimizerState::MemoryBytes(initial.size(), 1, compactHistory, floatHistory) << " bytes" << endl;
+			exit(1);
+		}
+	}
+
 	//输入依次为：优化问题、初始参数、limit-memory中记忆的迭代步数的数量、l1正则化项的参数、是否输出静默
-	OptimizerState state(function, initial, m, l1weight, quiet);
+	OptimizerState state(function, initial, m, l1weight, quiet, compactHistory, floatHistory, activeSet, stochFunc, initialBatch, batchGrowth);
+	state.lineSearch = lineSearch;
+	if (history != NULL) state.LoadHistory(*history);
+	if (cachedLineSearch) {
+		state.lsFunc = dynamic_cast<LineSearchFunction*>(&function);
+		if (state.lsFunc == NULL && !quiet) cout << "cached line search is not supported by this function; ignored" << endl;
+	}
 
 	if (!quiet) {
 		cout << setprecision(4) << scientific << right;
 		cout << endl << "Optimizing function of " << state.dim << " variables with OWL-QN parameters:" << endl;
 		cout << "   l1 regularization weight: " << l1weight << "." << endl;
-		cout << "   L-BFGS memory parameter (m): " << m << endl;
+		cout << "   L-BFGS memory parameter (m): " << state.m << (compactHistory ? " (compact)" : "") << (floatHistory ? " (float)" : "") << (limited ? " (limited by memory budget)" : "") << endl;
 		cout << "   Convergence tolerance: " << tol << endl;
+		if (activeSet) cout << "   Restricting each iteration to the active set" << endl;
+		if (stochFunc != NULL) {
+			cout << "   Mini-batch size: " << initialBatch << " growing by " << fixed << setprecision(2) << batchGrowth << " per iteration" << endl;
+			cout << setprecision(4) << scientific;
+		}
 		cout << endl;
-		cout << "Iter    n:  new_value    (conv_crit)   line_search" << endl << flush;
-		cout << "Iter    0:  " << setw(10) << state.value << "  (***********) " << flush;
+		cout << "Iter    n:  new_value    (conv_crit)   line_search (evaluations)" << endl << flush;
+		cout << "Iter    0:  " << setw(10) << state.value << "  (***********) " << endl;
 	}
 
+	//同一个OWLQN可以多次调用Minimize，终止条件从头开始记录
+	termCrit->Reset();
 	ostringstream str;
-	termCrit->GetValue(state, str);
+	if (state.GetBatchSize() == 0) termCrit->GetValue(state, str);
+
+	//有观察者时每次迭代统计各阶段，迭代结束时（Shift之后，shifted为false时是没有Shift的最后一次迭代）交给观察者
+	//shifted为true时按x、grad统计，否则按newX、newGrad
+	IterationStats iterStats;
+	chrono::steady_clock::time_point iterStart;
+	if (observer != NULL) observer->OnStart(state.dim, l1weight, state.m);
+	auto report = [&](double value, double convCrit, bool shifted) {
+		if (observer == NULL) return;
+		iterStats.seconds = chrono::duration<double>(chrono::steady_clock::now() - iterStart).count();
+		iterStats.value = value;
+		iterStats.convCrit = convCrit;
+		iterStats.step = state.lastAlpha;
+		iterStats.trials = state.GetLastEvals();
+		iterStats.activeCount = state.GetActiveCount();
+		if (shifted) state.MeasureOptimality(state.x, state.grad);
+		else state.MeasureOptimality(state.newX, state.newGrad);
+		state.stats = NULL;
+		observer->OnIteration(iterStats);
+	};
 
 	while (true) {
+		if (observer != NULL) {
+			iterStats = IterationStats(state.iter);
+			iterStats.batchSize = state.GetBatchSize();
+			state.stats = &iterStats;
+			iterStart = chrono::steady_clock::now();
+		}
 		//更新search direction
 		state.UpdateDir();
-		//查找step size
-		state.BackTrackingLineSearch();
+		//查找step size；方向为0时已经收敛，x没有移动，newGrad可能是Shift换下来的旧梯度，按x、grad统计
+		if (!state.FindStep()) {
+			report(state.value, NAN, true);
+			break;
+		}
+
+		//随机模式：不判断终止条件，直接换下一个batch；batch达到全部样本后从新的损失值开始判断
+		if (state.GetBatchSize() > 0) {
+			if (!quiet) {
+				cout << "Iter " << setw(4) << state.iter << ":  " << setw(10) << state.value;
+				cout << "  (batch " << state.GetBatchSize() << ") " << setw(4) << state.GetLastEvals() << endl;
+			}
+			//下一个batch上的计算也算在本次迭代中
+			double stepValue = state.value;
+			state.Shift();
+			bool more = state.NextBatch();
+			report(stepValue, NAN, true);
+			if (!more) {
+				termCrit->Reset();
+				termCrit->GetValue(state, str);
+			}
+			continue;
+		}
 
 		//判断是否满足终止条件
 		ostringstream str;
@@ -325,17 +775,21 @@ void OWLQN::Minimize(DifferentiableFunction& function, const DblVec& initial, Db
 		double termCritVal = termCrit->GetValue(state, str);
 		if (!quiet) {
 			cout << "Iter " << setw(4) << state.iter << ":  " << setw(10) << state.value;
-			cout << str.str() << flush;
+			cout << str.str() << setw(4) << state.GetLastEvals() << endl;
 		}
 		//如果减少的损失值相对于当前损失的比例小于某个阈值，就停止迭代
-		if (termCritVal < tol) break;
+		if (termCritVal < tol) {
+			report(state.value, termCritVal, false);
+			break;
+		}
 
 		//更新状态
 		state.Shift();
+		report(state.value, termCritVal, true);
 	}
-
-	if (!quiet) cout << endl;
+	state.stats = NULL;
 
 	//将最终得到的参数存到计算结果变量中
 	minimum = state.newX;
+	if (history != NULL) state.SaveHistory(*history);
 }
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <vector>
-#include <deque>
 #include <iostream>
+#include <random>
+
+#include "arena.h"
+#include "telemetry.h"
 
 typedef std::vector<double> DblVec;
 
@@ -11,58 +14,166 @@ struct DifferentiableFunction {
 	virtual ~DifferentiableFunction() { }
 };
 
+//ֻڲϼĿ꺯mini-batchģʽ
+struct StochasticDifferentiableFunction : public DifferentiableFunction {
+	virtual size_t NumInstances() const = 0;
+	//ֻbatchеʧݶȣֳNumInstances() / batch.size()ȫʱͬֲ
+	virtual double EvalBatch(const std::vector<size_t>& batch, const DblVec& input, DblVec& gradient) = 0;
+};
+
+//ԲпûĿ꺯ģ X(x + alpha * dir) = Xx + alpha * Xdir
+//OWLQNGetNextPointûаκάʱʹЩEval
+struct LineSearchFunction {
+	//ʼdirԲңxΪǰ㣻xdirԲҽǰ
+	virtual void BeginLineSearch(const DblVec& x, const DblVec& dir) = 0;
+	//x + alpha * dirʧݶ
+	virtual double EvalAtStep(double alpha) = 0;
+	//ܲalphax + alpha * dirݶȣʧ
+	virtual double AcceptStep(double alpha, DblVec& gradient) = 0;
+	virtual ~LineSearchFunction() { }
+};
+
+//ֻĿ꺯ɸѡ
+struct RestrictableFunction {
+	//ֻcolsе򣩵õĿ꺯kӦԭĵcols[k]Ĳ̶Ϊ0
+	//صĶԼݣɵͷ
+	virtual DifferentiableFunction* Restrict(const std::vector<size_t>& cols) const = 0;
+	virtual ~RestrictableFunction() { }
+};
+
+//һMinimizeʱL-BFGSϵµ˳洢һMinimizeΪʼļ
+//yĿ꺯⻬ֵݶ֮l1weight޹أԻһl1weight֮ȻЧ
+//άȻ洢ͣdouble/floatһβͬʱʹ
+struct LbfgsHistory {
+	size_t dim;
+	int count;
+	bool isFloat;
+	std::vector<double> s, y; //count * dimk[k * dim, (k + 1) * dim)
+	std::vector<float> sF, yF;
+	std::vector<double> ro;
+
+	LbfgsHistory() : dim(0), count(0), isFloat(false) { }
+};
+
 #include "TerminationCriterion.h"
+#include "lineSearch.h"
 
 class OWLQN {
 	bool quiet;
 	bool responsibleForTermCrit;
+	bool compactHistory;
+	size_t initialBatch; //ģʽĳʼbatchС0ʾʹģʽ
+	double batchGrowth;
+	bool cachedLineSearch;
+	bool floatHistory;
+	bool activeSet;
+	bool responsibleForLineSearch;
+	size_t memoryBudget; //Żڴޣֽڣ0ʾ
+	IterationObserver* observer;
 
 public:
 	TerminationCriterion *termCrit;
+	LineSearch *lineSearch; //ԲҵĲԣĬΪԲ
 
-	OWLQN(bool quiet = false) : quiet(quiet) {
+	OWLQN(bool quiet = false) : quiet(quiet), compactHistory(false), initialBatch(0), batchGrowth(1), cachedLineSearch(false), floatHistory(false), activeSet(false), memoryBudget(0), observer(NULL) {
 		termCrit = new RelativeMeanImprovementCriterion(5);
 		responsibleForTermCrit = true;
+		lineSearch = new BacktrackingLineSearch();
+		responsibleForLineSearch = true;
 	}
 
-	OWLQN(TerminationCriterion *termCrit, bool quiet = false) : quiet(quiet), termCrit(termCrit) { 
+	OWLQN(TerminationCriterion *termCrit, bool quiet = false) : quiet(quiet), compactHistory(false), initialBatch(0), batchGrowth(1), cachedLineSearch(false), floatHistory(false), activeSet(false), memoryBudget(0), observer(NULL), termCrit(termCrit) { 
 		responsibleForTermCrit = false;
+		lineSearch = new BacktrackingLineSearch();
+		responsibleForLineSearch = true;
 	}
 
 	~OWLQN() {
 		if (termCrit && responsibleForTermCrit) delete termCrit;
+		if (lineSearch && responsibleForLineSearch) delete lineSearch;
 	}
 
 	//ѰСʧĹ
 	//ΪŻ⡢ʼʱĲĽl1Ĳlimit-memoryмĵ
-	void Minimize(DifferentiableFunction& function, const DblVec& initial, DblVec& minimum, double l1weight = 1.0, double tol = 1e-4, int m = 10) const;
+	//historyΪNULLʱеļʼʱѼhistory
+	void Minimize(DifferentiableFunction& function, const DblVec& initial, DblVec& minimum, double l1weight = 1.0, double tol = 1e-4, int m = 10,
+		LbfgsHistory* history = NULL) const;
 	void SetQuiet(bool q) { quiet = q; }
+	//ʹcompactʾL-BFGSάGramtwo-loopϵֻηֿ
+	void SetCompactHistory(bool c) { compactHistory = c; }
+	//syfloat洢ڴÿεȡ룬ڻdoubleۼ
+	void SetFloatHistory(bool f) { floatHistory = f; }
+	//active setģʽÿεֻڻάȣx½άȣϼ㷽ԲңάȵxΪ0
+	//two-loopʹüڻάϵͶӰtwo-loopͬcompactģʽͬʱʹ
+	void SetActiveSet(bool a) { activeSet = a; }
+	//ģʽÿεֻһbatchϼ㣬batchinitialʼÿεgrowthﵽȫԭķ
+	//functionStochasticDifferentiableFunctiongrowth1
+	void SetStochastic(size_t initial, double growth) { initialBatch = initial; batchGrowth = growth; }
+	//Ŀ꺯LineSearchFunctionʱԲеĳԵû㣬ÿصEval
+	void SetCachedLineSearch(bool c) { cachedLineSearch = c; }
+	//ʹԲҲԣlsɵͷ
+	void SetLineSearch(LineSearch* ls) {
+		if (lineSearch && responsibleForLineSearch) delete lineSearch;
+		lineSearch = ls;
+		responsibleForLineSearch = false;
+	}
+	//Żڴ棨ͼޣʼǰmСڴ治bytesֵmΪ1Ҳʱ˳
+	void SetMemoryBudget(size_t bytes) { memoryBudget = bytes; }
+	//ÿεʱѸ׶εĺʱͼobsobsɵͷţNULLĬϣʱͳ
+	void SetObserver(IterationObserver* obs) { observer = obs; }
 
 };
 
 class OptimizerState {
 	friend class OWLQN;
+	friend struct LineSearch;
+	friend struct OptimizerBenchmark; //bench.cppֱӲtwo-loop
 
-	struct DblVecPtrDeque : public std::deque<DblVec*> {
-		~DblVecPtrDeque() {
-			for (size_t s = 0; s < size(); ++s) {
-				if ((*this)[s] != NULL) delete (*this)[s];
-			}
-		}
-	};
-
-	
 	DblVec x, grad, newX, newGrad, dir;//xΪgradΪĿ꺯ݶnewXΪµĲdirΪ
 	DblVec& steepestDescDir; //½½ references newGrad to save memory, since we don't ever use both at the same time
-	DblVecPtrDeque sList, yList; //lbfgs½еtwo-loopأsList¼֮ǰmεǰεĲĲֵyList¼֮ǰmεĵǰεݶȵĲֵ
-	std::deque<double> roList;//lbfgsл½еtwo-loopеrou
-	std::vector<double> alphas;//lbfgsл½еtwo-loopеalpha
+	//lbfgs½еtwo-loopصļm*dimĻλ
+	//sMatĵkм¼ĳεǰεĲĲֵsyMatĵkм¼ӦݶȵĲֵy
+	//histStartΪϵļڵУhistCountΪеļiϵ£ڵ(histStart + i) % m
+	//Щ鶼arenaУʱdimmһη䣬вڴ
+	//floatHistoryΪtrueʱsMatFyMatFУsMatyMatУйصļ㶼ǶԴ洢Tģ
+	double *sMat, *yMat;
+	float *sMatF, *yMatF;
+	int histStart, histCount;
+	double* roList;//lbfgsл½еtwo-loopеrouд洢
+	double* alphas;//lbfgsл½еtwo-loopеalpha
+	//compactģʽάGram󣨰кsyGram[a * m + b] = s_ay_byyGram[a * m + b] = y_ay_b
+	//two-loopϵֻm*mSYdirڻֻαdir
+	bool compact;
+	bool floatHistory;
+	double *syGram, *yyGram;
+	double* scratch; //ڻϵõ4*mʱֵ
+	//active setģʽactiveΪεĻάȣ򣩣prevActiveΪһεĻά
+	//ά֮xdir0ֻactiveϽУnewXprevActivexͬԲǰͬ
+	bool activeSet, haveActive;
+	std::vector<size_t> active, prevActive;
 	double value; //ǰĿ꺯ʧֵ
 	int iter, m; //iterΪŻĵļ¼mΪlimit-memoryҪ¼ĸ
 	const size_t dim; //ά
 	DifferentiableFunction& func;//ҪŻ
 	double l1weight;//l1ϵ
 	bool quiet; //ǷĬ
+	Arena arena;
+	//ģʽһεеԲҺµݶȶͬһbatchϼ㣬ԼsyͬһĿ꺯
+	//batchΪʱʹȫ
+	StochasticDifferentiableFunction* stochFunc;
+	std::vector<size_t> batch;
+	std::vector<size_t> perm; //Уbatchδȡȡһ´
+	size_t permPos;
+	double batchSize, batchGrowth;
+	std::mt19937 rng;
+	LineSearchFunction* lsFunc; //ΪNULLʱԲʹû
+	//Բҵ״̬Ŀ꺯ֵͷһγԵĲǷû㣨ʱûмݶȣεĿ꺯Ĵ
+	LineSearch* lineSearch;
+	double origValue, origDirDeriv, lastAlpha;
+	bool searchCached, lastCached;
+	int lastEvals;
+	//й۲ʱεͳƣΪNULL
+	IterationStats* stats;
 
 	static double dotProduct(const DblVec& a, const DblVec& b);
 	static void add(DblVec& a, const DblVec& b);
@@ -71,20 +182,57 @@ class OptimizerState {
 	static void scale(DblVec& a, double b);
 	static void scaleInto(DblVec& a, const DblVec& b, double c);
 
+	//arenaֽ
+	static size_t HistoryBytes(size_t dim, int m, bool compact, bool floatHistory);
+
+	int HistRow(int i) const { return (histStart + i) % m; }
+	//matеiϵ£
+	template <class T> T* Row(T* mat, int i) const { return mat + (size_t)HistRow(i) * dim; }
+
+	void AllocateHistory();
 	void MapDirByInverseHessian();
+	template <class T> void TwoLoop(const T* S, const T* Y);
+	template <class T> void TwoLoopCompact(const T* S, const T* Y);
+	template <class T> void StoreHistory(T* S, T* Y);
+	template <class T> void UpdateGram(const T* S, const T* Y);
+	template <class T> void TwoLoopActive(const T* S, const T* Y);
+	void UpdateActive();
+	void LoadHistory(const LbfgsHistory& h);
+	void SaveHistory(LbfgsHistory& h) const;
+	template <class T> void CopyRows(const T* S, const T* Y, std::vector<T>& s, std::vector<T>& y) const;
+	template <class T> void PutRows(T* S, T* Y, const std::vector<T>& s, const std::vector<T>& y, const std::vector<double>& ro, int first, int count);
+	double AbsSum(const DblVec& v) const;
 	void UpdateDir();
 	double DirDeriv() const;
-	void GetNextPoint(double alpha);
-	void BackTrackingLineSearch();
+	bool GetNextPoint(double alpha);
+	bool FindStep();
+	double TryStep(double alpha, bool needGrad);
+	void TakeStep(double alpha, double stepValue);
 	void Shift();
 	void MakeSteepestDescDir();
 	double EvalL1();
+	double EvalL1AtStep(double alpha);
 	void FixDirSigns();
 	void TestDirDeriv();
+	void SampleBatch();
+	bool NextBatch();
+	//ͳʱεphaseӦĽ׶ΣͳʱΪNULLPhaseTimerʱ
+	PhaseStats* Phase(PhaseStats IterationStats::* phase) { return stats != NULL ? &(stats->*phase) : NULL; }
+	//ͳʱۼӶдֽ
+	void Touch(double bytes) { if (stats != NULL) stats->bytesTouched += (uint64_t)bytes; }
+	//άactive setģʽΪάȵĸ
+	size_t WorkingDim() const { return haveActive ? active.size() : dim; }
+	//pointķάݶȵ2gradientΪpoint⻬ֵݶȣдstats
+	void MeasureOptimality(const DblVec& point, const DblVec& gradient);
 
 	//ΪŻ⡢ʼlimit-memoryмĵl1ĲǷĬ
-	OptimizerState(DifferentiableFunction& f, const DblVec& init, int m, double l1weight, bool quiet) 
-		: x(init), grad(init.size()), newX(init), newGrad(init.size()), dir(init.size()), steepestDescDir(newGrad), alphas(m), iter(1), m(m), dim(init.size()), func(f), l1weight(l1weight), quiet(quiet) {
+	//stochFuncΪNULLʱʹģʽbatchinitialBatchʼÿεbatchGrowth
+	OptimizerState(DifferentiableFunction& f, const DblVec& init, int m, double l1weight, bool quiet, bool compact = false, bool floatHistory = false, bool activeSet = false,
+		StochasticDifferentiableFunction* stochFunc = NULL, size_t initialBatch = 0, double batchGrowth = 1) 
+		: x(init), grad(init.size()), newX(init), newGrad(init.size()), dir(init.size()), steepestDescDir(newGrad), histStart(0), histCount(0), compact(compact), floatHistory(floatHistory), activeSet(activeSet), haveActive(false), iter(1), m(m), dim(init.size()), func(f), l1weight(l1weight), quiet(quiet),
+		arena(HistoryBytes(init.size(), m, compact, floatHistory)),
+		stochFunc(stochFunc), permPos(0), batchSize((double)initialBatch), batchGrowth(batchGrowth), lsFunc(NULL),
+		lineSearch(NULL), origValue(0), origDirDeriv(0), lastAlpha(0), searchCached(false), lastCached(false), lastEvals(0), stats(NULL) {
 		// ʼxʼΪʼgradʼΪȺͲһĿ
 		        //newXʼΪʼnewGradʼΪȺͲһĿ
 		        //dirʼΪȺͲһĿsteepestDescDirʼΪnewGradһĿ
@@ -95,6 +243,8 @@ class OptimizerState {
 				std::cerr << "m must be an integer greater than zero." << std::endl;
 				exit(1);
 			}
+			AllocateHistory();
+			if (stochFunc != NULL) SampleBatch();
 			//ݶȡʧ
 			value = EvalL1();
 			grad = newGrad;
@@ -107,6 +257,15 @@ public:
 	const DblVec& GetLastGrad() const { return grad; }
 	const DblVec& GetLastDir() const { return dir; }
 	double GetValue() const { return value; } 
+	//ǰbatchʹȫʱΪ0
+	size_t GetBatchSize() const { return batch.size(); }
 	int GetIter() const { return iter; }
+	//һԲҼĿ꺯Ĵ
+	int GetLastEvals() const { return lastEvals; }
 	size_t GetDim() const { return dim; }
+	//άȵĸʹactive setģʽʱΪdim
+	size_t GetActiveCount() const { return haveActive ? active.size() : dim; }
+
+	//dimάmʱŻռõڴ棺arena
+	static size_t MemoryBytes(size_t dim, int m, bool compact, bool floatHistory);
 };
@@ -8,6 +8,8 @@ class OptimizerState;
 
 struct TerminationCriterion {
 	virtual double GetValue(const OptimizerState& state, std::ostream& message) = 0;
+	//丢弃之前记录的损失值，目标函数改变后（例如从mini-batch换成全部样本）重新开始判断
+	virtual void Reset() { }
 	virtual ~TerminationCriterion() { }
 };
 
@@ -19,4 +21,5 @@ public:
 	RelativeMeanImprovementCriterion(int numItersToAvg = 5) : numItersToAvg(numItersToAvg) {}
 
 	double GetValue(const OptimizerState& state, std::ostream& message);
+	void Reset() { prevVals.clear(); }
 };
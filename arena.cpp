@@ -0,0 +1,57 @@
+#include "arena.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+static const size_t kHugePage = (size_t)2 << 20;
+
+Arena::Arena(size_t bytes) : base(NULL), capacity(bytes), used(0) {
+	if (bytes == 0) return;
+	size_t align = 64;
+	if (bytes >= kHugePage) {
+		align = kHugePage;
+		capacity = (bytes + kHugePage - 1) / kHugePage * kHugePage;
+	}
+#ifdef _WIN32
+	base = (char*)_aligned_malloc(capacity, align);
+#else
+	void* p = NULL;
+	if (posix_memalign(&p, align, capacity) == 0) base = (char*)p;
+#endif
+	if (base == NULL) {
+		cerr << "cannot allocate " << (capacity >> 20) << " MB of optimizer memory: reduce m or set a memory budget" << endl;
+		exit(1);
+	}
+#ifdef MADV_HUGEPAGE
+	if (align == kHugePage) madvise(base, capacity, MADV_HUGEPAGE);
+#endif
+	//在构造的线程上清零，页面都分配在这个线程的NUMA节点上（见arena.h）
+	memset(base, 0, capacity);
+}
+
+Arena::~Arena() {
+#ifdef _WIN32
+	_aligned_free(base);
+#else
+	free(base);
+#endif
+}
+
+void* Arena::Take(size_t bytes) {
+	if (used + bytes > capacity) {
+		cerr << "arena overflow: " << used + bytes << " bytes requested, " << capacity << " available" << endl;
+		exit(1);
+	}
+	void* p = base + used;
+	used += bytes;
+	return p;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+//一次申请的对齐内存块，依次切成若干个double数组，所有数组随Arena一起释放
+//每个数组从64字节（一条cache line）的边界开始；块不小于2MB时按2MB对齐，并在支持的平台上建议内核使用大页
+//构造时把整块清零，页面在构造的线程中一次性分配，之后使用时不会再触发缺页
+//NUMA：整块由构造的线程一次memset，按first-touch规则所有页面都在这个线程所在的节点上，没有分散到各线程的节点
+//OptimizerState的向量运算和two-loop都在调用Minimize的线程上执行（也是构造arena的线程），所以记忆项与使用它的线程在同一个节点；
+//-numa只让目标函数的样本数据留在各节点上，优化器的内存不跟随
+class Arena {
+	char* base;
+	size_t capacity, used;
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	//切出bytes字节（已按64字节取整）
+	void* Take(size_t bytes);
+
+public:
+	//n个元素（每个elemSize字节）的数组在Arena中占用的字节数（含对齐）
+	static size_t Bytes(size_t n, size_t elemSize = sizeof(double)) { return (n * elemSize + 63) / 64 * 64; }
+
+	//bytes为所有数组的Bytes之和；内存不足时输出错误并退出
+	explicit Arena(size_t bytes);
+	~Arena();
+
+	//切出n个double或float的数组（已清零）
+	double* Doubles(size_t n) { return (double*)Take(Bytes(n)); }
+	float* Floats(size_t n) { return (float*)Take(Bytes(n, sizeof(float))); }
+	size_t Capacity() const { return capacity; }
+};
@@ -0,0 +1,494 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <memory>
+
+#include "OWLQN.h"
+#include "logreg.h"
+#include "leastSquares.h"
+#include "synthetic.h"
+#include "telemetry.h"
+
+using namespace std;
+
+//在合成数据上测量样本矩阵的核函数、优化器的向量运算和two-loop，以及完整的Minimize
+//每个结果输出一行可读的文字，-json时同时写一行JSON，用于比较不同版本的性能
+void printUsageAndExit() {
+	cout << "Benchmarks the OWL-QN optimizer and objective kernels on synthetic data" << endl << endl;
+	cout << "usage: bench [options]" << endl;
+	cout << "options:" << endl;
+	cout << "  -spec <rows,cols,density[,skew[,wdensity]]>" << endl;
+	cout << "                 add a synthetic data set: density is the fraction of nonzeros per row (1 for dense)," << endl;
+	cout << "                 skew the Zipf exponent of feature frequencies and wdensity the fraction of nonzero" << endl;
+	cout << "                 true weights; may be repeated (default is 200000,100000,0.0002,1,0.05 and 20000,500,1)" << endl;
+	cout << "  -seed <value>  random seed of the generator (default is 1)" << endl;
+	cout << "  -micro         only run the kernel microbenchmarks" << endl;
+	cout << "  -e2e           only run the end-to-end Minimize benchmarks" << endl;
+	cout << "  -vecdim <value>" << endl;
+	cout << "                 length of the vectors in the vector op and two-loop benchmarks (default is 262144)" << endl;
+	cout << "  -mintime <seconds>" << endl;
+	cout << "                 minimum measured time of each microbenchmark (default is 0.2)" << endl;
+	cout << "  -l1frac <value>" << endl;
+	cout << "                 l1 weight of the end-to-end runs as a fraction of lambdaMax (default is 0.01)" << endl;
+	cout << "  -tol <value>   convergence tolerance of the end-to-end runs (default is 1e-4)" << endl;
+	cout << "  -m <value>     L-BFGS memory parameter (default is 10)" << endl;
+	cout << "  -threads <value>" << endl;
+	cout << "                 number of threads used to evaluate the objective (default is 1)" << endl;
+	cout << "  -reps <value>  repeat each end-to-end run and keep the fastest (default is 1)" << endl;
+	cout << "  -gap <value>   also report the time until the objective is within this relative gap of the" << endl;
+	cout << "                 final value (default is 1e-3)" << endl;
+	cout << "  -compact, -float, -activeset, -cachemargins, -linesearch <backtrack|interp>" << endl;
+	cout << "                 optimizer settings of the end-to-end runs, as in the trainer" << endl;
+	cout << "  -json <file>   write one JSON line per result to file" << endl;
+	cout << "  -write <prefix>" << endl;
+	cout << "                 write each data set k as <prefix><k>.mtx with logistic labels <prefix><k>.lab and" << endl;
+	cout << "                 least squares targets <prefix><k>.y, for benchmarking the trainer itself" << endl;
+	cout << endl;
+	exit(0);
+}
+
+typedef chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+	return chrono::duration<double>(Clock::now() - start).count();
+}
+
+//结果的输出：可读的一行写到cout，-json时同时写一行JSON
+class Reporter {
+	unique_ptr<ofstream> json;
+
+public:
+	void OpenJson(const char* filename) {
+		json.reset(new ofstream(filename));
+		if (!json->good()) {
+			cerr << "error opening json file " << filename << endl;
+			exit(1);
+		}
+		json->precision(9);
+	}
+
+	//name为结果的名称，tags为字符串字段，fields为数值字段
+	void Report(const string& name, const vector<pair<string, string> >& tags, const vector<pair<string, double> >& fields) {
+		cout << name;
+		for (size_t k = 0; k < tags.size(); k++) cout << " " << tags[k].first << "=" << tags[k].second;
+		cout << ":";
+		for (size_t k = 0; k < fields.size(); k++) cout << " " << fields[k].first << "=" << fields[k].second;
+		cout << endl;
+		if (!json) return;
+		*json << "{\"bench\": \"" << name << "\"";
+		for (size_t k = 0; k < tags.size(); k++) *json << ", \"" << tags[k].first << "\": \"" << tags[k].second << "\"";
+		for (size_t k = 0; k < fields.size(); k++) {
+			*json << ", \"" << fields[k].first << "\": ";
+			if (std::isfinite(fields[k].second)) *json << fields[k].second;
+			else *json << "null";
+		}
+		*json << "}" << endl;
+	}
+};
+
+//调用f的次数从1开始倍增，直到一轮的时间超过minSeconds / kRounds，再按这个次数测kRounds轮，返回每次调用的最短时间（秒）
+static const int kRounds = 5;
+
+template <class F>
+static double timePerCall(F f, double minSeconds) {
+	size_t reps = 1;
+	double elapsed;
+	while (true) {
+		Clock::time_point start = Clock::now();
+		for (size_t r = 0; r < reps; r++) f();
+		elapsed = secondsSince(start);
+		if (elapsed >= minSeconds / kRounds) break;
+		reps *= 2;
+	}
+	double best = elapsed / reps;
+	for (int k = 1; k < kRounds; k++) {
+		Clock::time_point start = Clock::now();
+		for (size_t r = 0; r < reps; r++) f();
+		best = min(best, secondsSince(start) / reps);
+	}
+	return best;
+}
+
+//防止被测的计算被优化掉
+static volatile double sink;
+
+static string specName(const SyntheticSpec& s) {
+	ostringstream str;
+	str << s.rows << "x" << s.cols << ",density=" << s.density << ",skew=" << s.skew << ",wdensity=" << s.weightDensity;
+	return str.str();
+}
+
+//two-loop基准的目标函数：0.5 * |x|^2，只在构造OptimizerState时计算一次
+struct QuadraticFunction : public DifferentiableFunction {
+	double Eval(const DblVec& input, DblVec& gradient) {
+		double val = 0;
+		for (size_t i = 0; i < input.size(); i++) {
+			val += 0.5 * input[i] * input[i];
+			gradient[i] = input[i];
+		}
+		return val;
+	}
+};
+
+//OptimizerState的向量运算和two-loop是私有的，这里作为友元直接调用
+struct OptimizerBenchmark {
+	static void VectorOps(Reporter& out, size_t dim, double minSeconds) {
+		mt19937_64 rng(7);
+		uniform_real_distribution<double> uniform(-1, 1);
+		DblVec a(dim), b(dim), c(dim), tiny(dim, 1e-12);
+		for (size_t i = 0; i < dim; i++) {
+			a[i] = uniform(rng);
+			b[i] = uniform(rng);
+			c[i] = uniform(rng);
+		}
+		//加上的量和系数都很小，重复调用时向量的值基本不变
+		struct Op {
+			const char* name;
+			int bytesPerElement; //每个元素读写的字节数
+		};
+		const Op ops[] = { { "dot", 16 }, { "add", 24 }, { "add_mult", 24 }, { "add_mult_into", 24 }, { "scale", 16 }, { "scale_into", 16 } };
+		for (int k = 0; k < 6; k++) {
+			double t = timePerCall([&]() {
+				switch (k) {
+				case 0: sink = OptimizerState::dotProduct(a, b); break;
+				case 1: OptimizerState::add(a, tiny); break;
+				case 2: OptimizerState::addMult(a, b, 1e-12); break;
+				case 3: OptimizerState::addMultInto(a, b, c, 1e-12); break;
+				case 4: OptimizerState::scale(a, 1 + 1e-12); break;
+				case 5: OptimizerState::scaleInto(a, b, 1 + 1e-12); break;
+				}
+			}, minSeconds);
+			double bytes = (double)ops[k].bytesPerElement * dim;
+			ostringstream d;
+			d << dim;
+			out.Report("vector_op", { { "op", ops[k].name }, { "dim", d.str() } },
+				{ { "ns_per_call", t * 1e9 }, { "gb_per_s", bytes / t * 1e-9 } });
+		}
+	}
+
+	//m个随机的记忆项（s·y > 0），测量MapDirByInverseHessian；每次调用前把dir恢复为同一个最速下降方向
+	static void TwoLoop(Reporter& out, size_t dim, int m, bool compact, bool floatHistory, double minSeconds) {
+		QuadraticFunction quadratic;
+		DblVec init(dim, 1.0);
+		OptimizerState state(quadratic, init, m, 0, true, compact, floatHistory);
+
+		mt19937_64 rng(11);
+		uniform_real_distribution<double> uniform(-1, 1);
+		LbfgsHistory h;
+		h.dim = dim;
+		h.count = m;
+		h.isFloat = floatHistory;
+		h.ro.resize(m);
+		vector<double> s((size_t)m * dim), y((size_t)m * dim);
+		for (size_t k = 0; k < s.size(); k++) {
+			s[k] = uniform(rng);
+			y[k] = s[k] * (1.5 + uniform(rng)) + 0.1 * uniform(rng);
+		}
+		if (floatHistory) {
+			h.sF.assign(s.begin(), s.end());
+			h.yF.assign(y.begin(), y.end());
+		} else {
+			h.s.swap(s);
+			h.y.swap(y);
+		}
+		for (int i = 0; i < m; i++) {
+			double ro = 0;
+			for (size_t k = (size_t)i * dim; k < (size_t)(i + 1) * dim; k++) {
+				ro += floatHistory ? (double)h.sF[k] * h.yF[k] : h.s[k] * h.y[k];
+			}
+			h.ro[i] = ro;
+		}
+		state.LoadHistory(h);
+
+		DblVec dir0(dim);
+		for (size_t i = 0; i < dim; i++) dir0[i] = uniform(rng);
+		double t = timePerCall([&]() {
+			state.dir = dir0;
+			state.MapDirByInverseHessian();
+		}, minSeconds);
+		//两个loop（或compact的两次遍历）各读一遍所有记忆项
+		double historyBytes = 4.0 * m * dim * (floatHistory ? sizeof(float) : sizeof(double));
+		ostringstream d, mm;
+		d << dim;
+		mm << m;
+		out.Report("two_loop", { { "dim", d.str() }, { "m", mm.str() }, { "compact", compact ? "yes" : "no" }, { "float", floatHistory ? "yes" : "no" } },
+			{ { "ms_per_call", t * 1e3 }, { "history_gb_per_s", historyBytes / t * 1e-9 } });
+	}
+};
+
+//样本矩阵的核函数：对每个样本计算一次ScoreOf或AddMultTo
+static void instanceKernels(Reporter& out, const SyntheticData& data, double minSeconds) {
+	unique_ptr<LogisticRegressionProblem> prob(MakeLogisticProblem(data));
+	size_t rows = prob->NumInstances(), cols = prob->NumFeats();
+	DblVec w(data.trueWeights), g(cols, 0.0);
+	double nonZeros = data.spec.IsDense() ? (double)rows * cols : (double)data.NumNonZeros();
+
+	double tScore = timePerCall([&]() {
+		double s = 0;
+		for (size_t i = 0; i < rows; i++) s += prob->ScoreOf(i, w);
+		sink = s;
+	}, minSeconds);
+	double tAdd = timePerCall([&]() {
+		for (size_t i = 0; i < rows; i++) prob->AddMultTo(i, 1e-12, g);
+	}, minSeconds);
+
+	vector<pair<string, string> > tags = { { "spec", specName(data.spec) } };
+	out.Report("score_of", tags, { { "ns_per_row", tScore / rows * 1e9 }, { "nonzeros_per_s", nonZeros / tScore } });
+	out.Report("add_mult_to", tags, { { "ns_per_row", tAdd / rows * 1e9 }, { "nonzeros_per_s", nonZeros / tAdd } });
+}
+
+//end-to-end运行的设置
+struct RunConfig {
+	double l1frac, tol, gap;
+	int m, numThreads, reps;
+	bool compact, floatHistory, activeSet, cacheMargins, interpolate;
+};
+
+//记录每次迭代的耗时、目标函数值和计算次数
+struct RecordingObserver : public IterationObserver {
+	vector<IterationStats> iters;
+	void OnIteration(const IterationStats& stats) { iters.push_back(stats); }
+};
+
+//在obj上运行一次Minimize：l1weight为l1frac * lambdaMax（lambdaMax = max|g_j(0)|）
+static void endToEnd(Reporter& out, const string& kind, const SyntheticSpec& spec, DifferentiableFunction& obj, const RunConfig& config) {
+	size_t dim = spec.cols;
+	DblVec zero(dim, 0.0), grad(dim), ans(dim);
+	obj.Eval(zero, grad);
+	double lambdaMax = 0;
+	for (size_t j = 0; j < dim; j++) lambdaMax = max(lambdaMax, fabs(grad[j]));
+	double l1weight = config.l1frac * lambdaMax;
+
+	InterpolatingLineSearch interpSearch;
+	double bestSeconds = 0;
+	RecordingObserver best;
+	for (int r = 0; r < config.reps; r++) {
+		OWLQN opt(true);
+		opt.SetCompactHistory(config.compact);
+		opt.SetFloatHistory(config.floatHistory);
+		opt.SetActiveSet(config.activeSet);
+		opt.SetCachedLineSearch(config.cacheMargins);
+		if (config.interpolate) opt.SetLineSearch(&interpSearch);
+		RecordingObserver observer;
+		opt.SetObserver(&observer);
+		Clock::time_point start = Clock::now();
+		opt.Minimize(obj, zero, ans, l1weight, config.tol, config.m);
+		double seconds = secondsSince(start);
+		if (r == 0 || seconds < bestSeconds) {
+			bestSeconds = seconds;
+			best.iters.swap(observer.iters);
+		}
+	}
+
+	//各次迭代的统计：计算目标函数的次数（完整的Eval和用缓存的计算），以及目标函数值第一次进入最终值的gap之内的时间
+	const vector<IterationStats>& iters = best.iters;
+	double evals = 0, evalSeconds = 0, elapsed = 0, gapSeconds = NAN;
+	double finalValue = iters.empty() ? 0 : iters.back().value;
+	for (size_t k = 0; k < iters.size(); k++) {
+		evals += iters[k].eval.calls + iters[k].cachedEval.calls;
+		evalSeconds += iters[k].eval.seconds + iters[k].cachedEval.seconds;
+		elapsed += iters[k].seconds;
+		if (std::isnan(gapSeconds) && iters[k].value - finalValue <= config.gap * fabs(finalValue)) gapSeconds = elapsed;
+	}
+	double n = (double)max((size_t)1, iters.size());
+	size_t nonZeros = 0;
+	for (size_t j = 0; j < dim; j++) {
+		if (ans[j] != 0) nonZeros++;
+	}
+	out.Report("minimize", { { "kind", kind }, { "spec", specName(spec) } }, {
+		{ "l1weight", l1weight },
+		{ "iterations", (double)iters.size() },
+		{ "seconds", bestSeconds },
+		{ "seconds_per_iter", bestSeconds / n },
+		{ "seconds_to_gap", gapSeconds },
+		{ "evals_per_iter", evals / n },
+		{ "eval_fraction", evalSeconds / max(bestSeconds, 1e-300) },
+		{ "value", finalValue },
+		{ "residual", iters.empty() ? NAN : iters.back().residual },
+		{ "nonzeros", (double)nonZeros } });
+}
+
+//解析rows,cols,density[,skew[,wdensity]]
+static bool parseSpec(const char* s, SyntheticSpec& spec) {
+	double vals[5] = { 0, 0, 0, spec.skew, spec.weightDensity };
+	int count = 0;
+	while (count < 5) {
+		char* end;
+		vals[count++] = strtod(s, &end);
+		if (end == s) return false;
+		if (*end == '\0') break;
+		if (*end != ',') return false;
+		s = end + 1;
+	}
+	if (count < 3 || vals[0] < 1 || vals[1] < 1 || vals[2] <= 0 || vals[3] < 0 || vals[4] < 0) return false;
+	spec.rows = (size_t)vals[0];
+	spec.cols = (size_t)vals[1];
+	spec.density = vals[2];
+	spec.skew = vals[3];
+	spec.weightDensity = vals[4];
+	return true;
+}
+
+int main(int argc, char* argv[]) {
+	vector<SyntheticSpec> specs;
+	uint64_t seed = 1;
+	bool runMicro = true, runE2E = true;
+	size_t vecDim = 262144;
+	double minSeconds = 0.2;
+	RunConfig config = { 0.01, 1e-4, 1e-3, 10, 1, 1, false, false, false, false, false };
+	const char* jsonFile = NULL;
+	const char* writePrefix = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-help") || !strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) printUsageAndExit();
+		else if (!strcmp(argv[i], "-micro")) runE2E = false;
+		else if (!strcmp(argv[i], "-e2e")) runMicro = false;
+		else if (!strcmp(argv[i], "-compact")) config.compact = true;
+		else if (!strcmp(argv[i], "-float")) config.floatHistory = true;
+		else if (!strcmp(argv[i], "-activeset")) config.activeSet = true;
+		else if (!strcmp(argv[i], "-cachemargins")) config.cacheMargins = true;
+		else if (!strcmp(argv[i], "-spec")) {
+			SyntheticSpec spec;
+			++i;
+			if (i >= argc || !parseSpec(argv[i], spec)) {
+				cout << "-spec flag requires rows,cols,density[,skew[,wdensity]] with positive rows, cols and density." << endl;
+				exit(1);
+			}
+			specs.push_back(spec);
+		} else if (!strcmp(argv[i], "-seed")) {
+			++i;
+			if (i >= argc) {
+				cout << "-seed flag requires 1 int argument." << endl;
+				exit(1);
+			}
+			seed = strtoull(argv[i], NULL, 10);
+		} else if (!strcmp(argv[i], "-vecdim")) {
+			++i;
+			if (i >= argc || atol(argv[i]) <= 0) {
+				cout << "-vecdim flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+			vecDim = (size_t)atol(argv[i]);
+		} else if (!strcmp(argv[i], "-mintime")) {
+			++i;
+			if (i >= argc || (minSeconds = atof(argv[i])) <= 0) {
+				cout << "-mintime flag requires 1 positive real argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-l1frac")) {
+			++i;
+			if (i >= argc || (config.l1frac = atof(argv[i])) < 0) {
+				cout << "-l1frac flag requires 1 non-negative real argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-tol")) {
+			++i;
+			if (i >= argc || (config.tol = atof(argv[i])) <= 0) {
+				cout << "-tol flag requires 1 positive real argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-gap")) {
+			++i;
+			if (i >= argc || (config.gap = atof(argv[i])) < 0) {
+				cout << "-gap flag requires 1 non-negative real argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-m")) {
+			++i;
+			if (i >= argc || (config.m = atoi(argv[i])) <= 0) {
+				cout << "-m flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-threads")) {
+			++i;
+			if (i >= argc || (config.numThreads = atoi(argv[i])) <= 0) {
+				cout << "-threads flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-reps")) {
+			++i;
+			if (i >= argc || (config.reps = atoi(argv[i])) <= 0) {
+				cout << "-reps flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-linesearch")) {
+			++i;
+			if (i >= argc || (strcmp(argv[i], "backtrack") && strcmp(argv[i], "interp"))) {
+				cout << "-linesearch flag requires 1 argument: backtrack or interp." << endl;
+				exit(1);
+			}
+			config.interpolate = !strcmp(argv[i], "interp");
+		} else if (!strcmp(argv[i], "-json")) {
+			++i;
+			if (i >= argc) {
+				cout << "-json flag requires 1 argument: the output file." << endl;
+				exit(1);
+			}
+			jsonFile = argv[i];
+		} else if (!strcmp(argv[i], "-write")) {
+			++i;
+			if (i >= argc) {
+				cout << "-write flag requires 1 argument: the file name prefix." << endl;
+				exit(1);
+			}
+			writePrefix = argv[i];
+		} else {
+			cerr << "unrecognized argument: " << argv[i] << endl;
+			exit(1);
+		}
+	}
+
+	if (specs.empty()) {
+		SyntheticSpec sparse, dense;
+		parseSpec("200000,100000,0.0002,1,0.05", sparse);
+		parseSpec("20000,500,1,0,0.2", dense);
+		specs.push_back(sparse);
+		specs.push_back(dense);
+	}
+	for (size_t k = 0; k < specs.size(); k++) specs[k].seed = seed + k;
+
+	Reporter out;
+	if (jsonFile != NULL) out.OpenJson(jsonFile);
+
+	if (runMicro) {
+		OptimizerBenchmark::VectorOps(out, vecDim, minSeconds);
+		for (int c = 0; c < 2; c++) {
+			for (int f = 0; f < 2; f++) OptimizerBenchmark::TwoLoop(out, vecDim, config.m, c == 1, f == 1, minSeconds);
+		}
+	}
+
+	for (size_t k = 0; k < specs.size(); k++) {
+		SyntheticData logData, lsData;
+		GenerateSynthetic(specs[k], true, logData);
+		GenerateSynthetic(specs[k], false, lsData);
+		cout << "data set " << k << ": " << specName(specs[k]) << ", " << logData.NumNonZeros() << " nonzeros" << endl;
+		if (writePrefix != NULL) {
+			ostringstream name;
+			name << writePrefix << k;
+			logData.WriteFeatures((name.str() + ".mtx").c_str());
+			logData.WriteLabels((name.str() + ".lab").c_str());
+			lsData.WriteLabels((name.str() + ".y").c_str());
+		}
+
+		if (runMicro) instanceKernels(out, logData, minSeconds);
+		if (runE2E) {
+			unique_ptr<LogisticRegressionProblem> logProb(MakeLogisticProblem(logData));
+			LogisticRegressionObjective logObj(*logProb, 0, config.numThreads);
+			endToEnd(out, "logistic", specs[k], logObj, config);
+
+			unique_ptr<LeastSquaresProblem> lsProb(MakeLeastSquaresProblem(lsData));
+			LeastSquaresObjective lsObj(*lsProb, 0, config.numThreads);
+			endToEnd(out, "least_squares", specs[k], lsObj, config);
+		}
+	}
+
+	return 0;
+}
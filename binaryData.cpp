@@ -0,0 +1,267 @@
+#include "binaryData.h"
+#include "instanceMatrix.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+static const char kMagic[8] = { 'O', 'W', 'L', 'Q', 'N', 'B', 'I', 'N' };
+
+MappedFile::MappedFile(const char* filename) : data(NULL), size(0), buffer(NULL) {
+#ifdef _WIN32
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL) {
+		cerr << "error opening binary data file " << filename << endl;
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	size = (size_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buffer = malloc(size > 0 ? size : 1);
+	if (buffer == NULL || fread(buffer, 1, size, f) != size) {
+		cerr << "error reading binary data file " << filename << endl;
+		exit(1);
+	}
+	fclose(f);
+	data = (const char*)buffer;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		cerr << "error opening binary data file " << filename << endl;
+		exit(1);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		cerr << "error reading binary data file " << filename << endl;
+		exit(1);
+	}
+	size = (size_t)st.st_size;
+	if (size > 0) {
+		//共享映射：同一台机器上的多个训练进程共用page cache里的同一份数据
+		void* p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			cerr << "error mapping binary data file " << filename << endl;
+			exit(1);
+		}
+		data = (const char*)p;
+	}
+	close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	free(buffer);
+#else
+	if (data != NULL) munmap((void*)data, size);
+#endif
+}
+
+BinaryDataReader::BinaryDataReader(const char* filename) : filename(filename) {
+#ifdef _WIN32
+	file = fopen(filename, "rb");
+	if (file == NULL) {
+#else
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+#endif
+		cerr << "error opening binary data file " << filename << endl;
+		exit(1);
+	}
+}
+
+BinaryDataReader::~BinaryDataReader() {
+#ifdef _WIN32
+	fclose(file);
+#else
+	close(fd);
+#endif
+}
+
+void BinaryDataReader::ReadAt(uint64_t offset, void* dst, uint64_t bytes) const {
+	char* p = (char*)dst;
+#ifdef _WIN32
+	//没有pread：同一时刻只能有一个线程读同一个文件
+	if (_fseeki64(file, (__int64)offset, SEEK_SET) != 0 || fread(p, 1, (size_t)bytes, file) != bytes) {
+		cerr << "error reading binary data file " << filename << endl;
+		exit(1);
+	}
+#else
+	while (bytes > 0) {
+		ssize_t n = pread(fd, p, (size_t)bytes, (off_t)offset);
+		if (n <= 0) {
+			cerr << "error reading binary data file " << filename << endl;
+			exit(1);
+		}
+		p += n;
+		offset += n;
+		bytes -= n;
+	}
+#endif
+}
+
+uint64_t RowStartsBytes(const BinaryDataHeader& h) {
+	return (h.layout == InstanceMatrix::Sparse) ? (h.numRows + 1) * sizeof(uint64_t) : 0;
+}
+
+uint64_t IndicesBytes(const BinaryDataHeader& h) {
+	return (h.layout == InstanceMatrix::Sparse) ? h.numNonZeros * h.indexBytes : 0;
+}
+
+uint64_t ValuesBytes(const BinaryDataHeader& h) {
+	return h.numNonZeros * sizeof(float);
+}
+
+uint64_t LabelsBytes(const BinaryDataHeader& h) {
+	if (h.kind == LogisticData) return (h.numRows + 63) / 64 * sizeof(uint64_t);
+	return h.numRows * sizeof(float);
+}
+
+bool IsBinaryDataFile(const char* filename) {
+	ifstream file(filename, ios::binary);
+	char magic[8];
+	return file.read(magic, sizeof(magic)) && !memcmp(magic, kMagic, sizeof(magic));
+}
+
+static void checkArray(const char* filename, uint64_t offset, uint64_t bytes, uint64_t fileSize) {
+	if (bytes > 0 && (offset % 64 != 0 || offset > fileSize || bytes > fileSize - offset)) {
+		cerr << "corrupt binary data file " << filename << endl;
+		exit(1);
+	}
+}
+
+bool CheckSparseArrays(const uint64_t* rowStarts, size_t numRows, const void* indices, uint32_t indexBytes, uint64_t numNonZeros, uint64_t numCols) {
+	if (rowStarts[0] != 0 || rowStarts[numRows] != numNonZeros) return false;
+	for (size_t i = 0; i < numRows; i++) {
+		if (rowStarts[i] > rowStarts[i + 1]) return false;
+	}
+	//rowStarts[numRows] == numNonZeros且单调，所以每一行都在indices和values之内
+	if (indexBytes == 4) {
+		const uint32_t* inds = (const uint32_t*)indices;
+		for (uint64_t k = 0; k < numNonZeros; k++) {
+			if (inds[k] >= numCols) return false;
+		}
+	} else {
+		const uint64_t* inds = (const uint64_t*)indices;
+		for (uint64_t k = 0; k < numNonZeros; k++) {
+			if (inds[k] >= numCols) return false;
+		}
+	}
+	return true;
+}
+
+static bool mulOverflows(uint64_t a, uint64_t b) {
+	return a != 0 && b > UINT64_MAX / a;
+}
+
+static void checkHeader(const char* filename, const BinaryDataHeader& h, BinaryDataKind kind, uint64_t fileSize) {
+	if (memcmp(h.magic, kMagic, sizeof(kMagic))) {
+		cerr << "not a binary data file: " << filename << endl;
+		exit(1);
+	}
+	if (h.version != kBinaryDataVersion) {
+		cerr << "unsupported binary data version " << h.version << " in " << filename << endl;
+		exit(1);
+	}
+	if (h.kind != (uint32_t)kind) {
+		cerr << "binary data file " << filename << " was written for a different problem type" << endl;
+		exit(1);
+	}
+	bool sparse = (h.layout == InstanceMatrix::Sparse);
+	//各数组都在文件之内，所以每个非零元至少占4字节，每个样本的label至少占1位；先按这些上界检查维度，之后各数组字节数的乘法不会溢出
+	if ((!sparse && h.layout != InstanceMatrix::Dense) || (sparse && h.indexBytes != 4 && h.indexBytes != 8)
+		|| h.fileSize != fileSize || h.numNonZeros > fileSize / sizeof(float) || h.numRows / 8 > fileSize
+		|| (!sparse && (mulOverflows(h.numRows, h.numCols) || h.numNonZeros != h.numRows * h.numCols))
+		|| (sparse && h.indexBytes == 4 && h.numCols > (uint64_t)UINT32_MAX + 1)) {
+		cerr << "corrupt binary data file " << filename << endl;
+		exit(1);
+	}
+	checkArray(filename, h.rowStartsOffset, RowStartsBytes(h), fileSize);
+	checkArray(filename, h.indicesOffset, IndicesBytes(h), fileSize);
+	checkArray(filename, h.valuesOffset, ValuesBytes(h), fileSize);
+	checkArray(filename, h.labelsOffset, LabelsBytes(h), fileSize);
+}
+
+BinaryDataHeader ReadBinaryDataHeader(const char* filename, BinaryDataKind kind) {
+	ifstream file(filename, ios::binary);
+	BinaryDataHeader h;
+	if (!file.read((char*)&h, sizeof(h))) {
+		cerr << "error reading binary data file " << filename << endl;
+		exit(1);
+	}
+	file.seekg(0, ios::end);
+	checkHeader(filename, h, kind, (uint64_t)file.tellg());
+	return h;
+}
+
+shared_ptr<MappedFile> MapBinaryData(const char* filename, BinaryDataKind kind, const BinaryDataHeader*& header) {
+	shared_ptr<MappedFile> file(new MappedFile(filename));
+	if (file->Size() < sizeof(BinaryDataHeader)) {
+		cerr << "not a binary data file: " << filename << endl;
+		exit(1);
+	}
+	header = (const BinaryDataHeader*)file->Data();
+	checkHeader(filename, *header, kind, file->Size());
+	//稀疏时检查rowStarts和所有列下标，损坏的文件不会在计算中越界读写
+	if (header->layout == InstanceMatrix::Sparse && header->numRows > 0) {
+		const uint64_t* rowStarts = (const uint64_t*)(file->Data() + header->rowStartsOffset);
+		if (!CheckSparseArrays(rowStarts, header->numRows, file->Data() + header->indicesOffset, header->indexBytes, header->numNonZeros, header->numCols)) {
+			cerr << "corrupt binary data file " << filename << endl;
+			exit(1);
+		}
+	}
+	return file;
+}
+
+static uint64_t alignUp(uint64_t offset) {
+	return (offset + 63) / 64 * 64;
+}
+
+static void writeArray(ofstream& out, uint64_t offset, const void* data, uint64_t bytes) {
+	if (bytes == 0) return;
+	static const char zeros[64] = { 0 };
+	out.write(zeros, (streamsize)(offset - (uint64_t)out.tellp()));
+	out.write((const char*)data, (streamsize)bytes);
+}
+
+void WriteBinaryData(const char* filename, BinaryDataHeader h, const void* rowStarts, const void* indices, const void* values, const void* labels) {
+	memcpy(h.magic, kMagic, sizeof(kMagic));
+	h.version = kBinaryDataVersion;
+
+	uint64_t offset = alignUp(sizeof(h));
+	h.rowStartsOffset = RowStartsBytes(h) ? offset : 0;
+	offset = alignUp(offset + RowStartsBytes(h));
+	h.indicesOffset = IndicesBytes(h) ? offset : 0;
+	offset = alignUp(offset + IndicesBytes(h));
+	h.valuesOffset = ValuesBytes(h) ? offset : 0;
+	offset = alignUp(offset + ValuesBytes(h));
+	h.labelsOffset = LabelsBytes(h) ? offset : 0;
+	h.fileSize = offset + LabelsBytes(h);
+
+	ofstream out(filename, ios::binary);
+	if (!out.good()) {
+		cerr << "error opening binary data file " << filename << endl;
+		exit(1);
+	}
+	out.write((const char*)&h, sizeof(h));
+	writeArray(out, h.rowStartsOffset, rowStarts, RowStartsBytes(h));
+	writeArray(out, h.indicesOffset, indices, IndicesBytes(h));
+	writeArray(out, h.valuesOffset, values, ValuesBytes(h));
+	writeArray(out, h.labelsOffset, labels, LabelsBytes(h));
+	if (!out.good()) {
+		cerr << "error writing binary data file " << filename << endl;
+		exit(1);
+	}
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <cstdio>
+#include <stdint.h>
+
+//二进制数据集文件（版本1）
+//文件头BinaryDataHeader之后依次是各个数组，每个数组的起始位置按64字节对齐，offset是从文件开头算起的字节数
+//  kind == LogisticData：
+//    rowStarts  uint64 * (numRows + 1)，仅稀疏格式
+//    indices    uint32或uint64(indexBytes) * numNonZeros，仅稀疏格式
+//    values     float * numNonZeros，稠密格式时按行存储，numNonZeros = numRows * numCols
+//    labels     uint64 * ceil(numRows / 64)，第i个样本的label在第i / 64个字的第i % 64位
+//  kind == LeastSquaresData：
+//    rowStarts、indices与LogisticData相同，仅稀疏格式
+//    values     稀疏格式时与LogisticData相同；稠密格式时为float * numRows * numCols，按列存储
+//    labels     float * numRows，即b
+//数值按小端存储，与内存中的表示相同，所以读入时直接把文件映射到内存使用，不做拷贝
+struct BinaryDataHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t kind;
+	uint32_t layout; //InstanceMatrix::Layout
+	uint32_t indexBytes;
+	uint64_t numRows, numCols, numNonZeros;
+	uint64_t rowStartsOffset, indicesOffset, valuesOffset, labelsOffset;
+	uint64_t fileSize;
+};
+
+enum BinaryDataKind { LogisticData = 1, LeastSquaresData = 2 };
+
+const uint32_t kBinaryDataVersion = 1;
+
+//只读映射整个文件，析构时解除映射
+class MappedFile {
+	const char* data;
+	size_t size;
+	void* buffer; //不支持mmap的平台上把文件读到这块内存里
+
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+public:
+	explicit MappedFile(const char* filename);
+	~MappedFile();
+
+	const char* Data() const { return data; }
+	size_t Size() const { return size; }
+};
+
+//按位置读文件的一段，可以在多个线程中同时使用；用于不把整个文件放进内存的流式读入
+class BinaryDataReader {
+	std::string filename;
+#ifdef _WIN32
+	FILE* file;
+#else
+	int fd;
+#endif
+
+	BinaryDataReader(const BinaryDataReader&);
+	BinaryDataReader& operator=(const BinaryDataReader&);
+
+public:
+	explicit BinaryDataReader(const char* filename);
+	~BinaryDataReader();
+
+	const std::string& Name() const { return filename; }
+
+	//读入从offset开始的bytes个字节，读不满时输出错误并退出
+	void ReadAt(uint64_t offset, void* dst, uint64_t bytes) const;
+};
+
+//各个数组的字节数，由文件头决定
+uint64_t RowStartsBytes(const BinaryDataHeader& h);
+uint64_t IndicesBytes(const BinaryDataHeader& h);
+uint64_t ValuesBytes(const BinaryDataHeader& h);
+uint64_t LabelsBytes(const BinaryDataHeader& h);
+
+//检查稀疏格式的数组：rowStarts[0]为0、单调不减、rowStarts[numRows]为numNonZeros，所有列下标小于numCols
+//indices为indexBytes（4或8）字节的下标；需要遍历所有非零元
+bool CheckSparseArrays(const uint64_t* rowStarts, size_t numRows, const void* indices, uint32_t indexBytes, uint64_t numNonZeros, uint64_t numCols);
+
+//文件是否以二进制数据集的magic开头
+bool IsBinaryDataFile(const char* filename);
+
+//读入并检查文件头，文件不合法时输出错误并退出
+BinaryDataHeader ReadBinaryDataHeader(const char* filename, BinaryDataKind kind);
+
+//映射二进制数据集并检查文件头，header指向映射内存中的文件头
+std::shared_ptr<MappedFile> MapBinaryData(const char* filename, BinaryDataKind kind, const BinaryDataHeader*& header);
+
+//写二进制数据集：header中只需填kind、layout、indexBytes和各个维度，offset由这里计算；不存在的数组传NULL
+void WriteBinaryData(const char* filename, BinaryDataHeader header, const void* rowStarts, const void* indices, const void* values, const void* labels);
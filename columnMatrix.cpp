@@ -0,0 +1,68 @@
+#include "columnMatrix.h"
+
+#include <algorithm>
+
+using namespace std;
+
+bool UseColumnGradient(GradientMode mode, const InstanceMatrix& rows, int numThreads) {
+	if (mode == RowGradient || rows.GetLayout() != InstanceMatrix::Sparse || (uint64_t)rows.NumRows() > 0xFFFFFFFFull) return false;
+	if (mode == ColumnGradient) return true;
+	//线程的梯度缓冲(numThreads - 1) * dim个double，CSC副本每个非零元一个下标和一个值，也是8字节
+	return numThreads > 1 && (uint64_t)(numThreads - 1) * rows.NumCols() > (uint64_t)rows.NumNonZeros() + rows.NumCols();
+}
+
+template <class Index>
+static void countColumns(const uint64_t* starts, const Index* inds, size_t numRows, vector<uint64_t>& colStarts) {
+	for (uint64_t k = starts[0]; k < starts[numRows]; k++) colStarts[inds[k] + 1]++;
+}
+
+template <class Index>
+static void placeColumns(const uint64_t* starts, const Index* inds, const float* vals, size_t numRows,
+	vector<uint64_t>& next, vector<uint32_t>& rowIndices, vector<float>& values) {
+	for (size_t i = 0; i < numRows; i++) {
+		for (uint64_t k = starts[i]; k < starts[i + 1]; k++) {
+			uint64_t pos = next[inds[k]]++;
+			rowIndices[pos] = (uint32_t)i;
+			values[pos] = vals[k];
+		}
+	}
+}
+
+//计数排序：先数出每列的元素个数得到列偏移，再按行号顺序把元素放到各列的位置
+ColumnMatrix::ColumnMatrix(const InstanceMatrix& rows) : numRows(rows.NumRows()), numCols(rows.NumCols()), colStarts(rows.NumCols() + 1, 0) {
+	if (numRows == 0) return;
+	const uint64_t* starts = rows.RowStartsData();
+	const float* vals = rows.ValuesData();
+	bool wide = (rows.IndexBytes() == 8);
+	if (wide) countColumns(starts, (const uint64_t*)rows.IndicesData(), numRows, colStarts);
+	else countColumns(starts, (const uint32_t*)rows.IndicesData(), numRows, colStarts);
+	for (size_t j = 0; j < numCols; j++) colStarts[j + 1] += colStarts[j];
+
+	rowIndices.resize(colStarts[numCols]);
+	values.resize(colStarts[numCols]);
+	vector<uint64_t> next(colStarts.begin(), colStarts.end() - 1);
+	if (wide) placeColumns(starts, (const uint64_t*)rows.IndicesData(), vals, numRows, next, rowIndices, values);
+	else placeColumns(starts, (const uint32_t*)rows.IndicesData(), vals, numRows, next, rowIndices, values);
+}
+
+//第t个分界是累计非零元个数达到总数的t / numParts处的列
+vector<size_t> ColumnMatrix::Partition(int numParts) const {
+	vector<size_t> bounds(numParts + 1, numCols);
+	bounds[0] = 0;
+	uint64_t total = colStarts[numCols];
+	for (int t = 1; t < numParts; t++) {
+		uint64_t target = total / numParts * t;
+		bounds[t] = max(bounds[t - 1], (size_t)(upper_bound(colStarts.begin(), colStarts.end(), target) - colStarts.begin()) - 1);
+	}
+	return bounds;
+}
+
+void ColumnMatrix::AddTransposeMult(const double* r, double scale, double* out, size_t colBegin, size_t colEnd) const {
+	for (size_t j = colBegin; j < colEnd; j++) {
+		double s = 0;
+		for (uint64_t k = colStarts[j]; k < colStarts[j + 1]; k++) {
+			s += values[k] * r[rowIndices[k]];
+		}
+		out[j] += scale * s;
+	}
+}
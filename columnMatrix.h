@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "instanceMatrix.h"
+
+//并行计算梯度X' * r的方式
+//  RowGradient：样本按行分给各线程，每个线程把r_i * X_i加到自己的梯度缓冲上，最后归约；缓冲占(numThreads - 1) * dim个double
+//  ColumnGradient：先按行算出各样本的r_i，再用按列存储的副本把特征按列分给各线程，每个线程只写梯度中自己的那一段；
+//    多占一份CSC副本（每个非零元8字节），不需要梯度缓冲；梯度的每个分量按行号顺序累加，所以梯度与线程数无关
+//  AutoGradient：稀疏样本、多线程、且线程的梯度缓冲比CSC副本还大时（特征很多、每个特征出现的次数少）用ColumnGradient
+enum GradientMode { AutoGradient, RowGradient, ColumnGradient };
+
+//按样本矩阵的形状和线程数决定是否使用ColumnGradient；稠密样本和行数超过uint32范围的样本总是按行计算
+bool UseColumnGradient(GradientMode mode, const InstanceMatrix& rows, int numThreads);
+
+//稀疏样本矩阵按列存储的副本（CSC）：第j列在rowIndices和values中的位置为colStarts[j]到colStarts[j+1] - 1，同一列中行号升序
+class ColumnMatrix {
+	size_t numRows, numCols;
+	std::vector<uint64_t> colStarts;
+	std::vector<uint32_t> rowIndices;
+	std::vector<float> values;
+
+	ColumnMatrix(const ColumnMatrix&);
+	ColumnMatrix& operator=(const ColumnMatrix&);
+
+public:
+	//由稀疏的InstanceMatrix计数排序得到，只构造一次
+	explicit ColumnMatrix(const InstanceMatrix& rows);
+
+	//把列分成numParts段，各段的非零元个数大致相同，返回numParts + 1个分界
+	std::vector<size_t> Partition(int numParts) const;
+
+	//out[j] += scale * sum_i X(i, j) * r[i]，j在[colBegin, colEnd)中
+	void AddTransposeMult(const double* r, double scale, double* out, size_t colBegin, size_t colEnd) const;
+
+	size_t NumNonZeros() const { return values.size(); }
+};
@@ -0,0 +1,161 @@
+#include "communicator.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+#ifdef _WIN32
+
+SocketCommunicator::SocketCommunicator(const char* path, int rank, int size, double timeoutSec) : rank(rank), size(size), path(path), listenFd(-1) {
+	cerr << "SocketCommunicator is not supported on this platform" << endl;
+	exit(1);
+}
+
+SocketCommunicator::~SocketCommunicator() { }
+void SocketCommunicator::AllReduceSum(double* data, size_t n) { }
+void SocketCommunicator::Broadcast(double* data, size_t n) { }
+
+#else
+
+//读写满len字节，对方断开或出错时退出
+static void writeAll(int fd, const void* buf, size_t len) {
+	const char* p = (const char*)buf;
+	while (len > 0) {
+		ssize_t k = write(fd, p, len);
+		if (k < 0 && errno == EINTR) continue;
+		if (k <= 0) {
+			cerr << "error writing to peer process: " << strerror(errno) << endl;
+			exit(1);
+		}
+		p += k;
+		len -= k;
+	}
+}
+
+static void readAll(int fd, void* buf, size_t len) {
+	char* p = (char*)buf;
+	while (len > 0) {
+		ssize_t k = read(fd, p, len);
+		if (k < 0 && errno == EINTR) continue;
+		if (k <= 0) {
+			cerr << "lost connection to peer process" << endl;
+			exit(1);
+		}
+		p += k;
+		len -= k;
+	}
+}
+
+SocketCommunicator::SocketCommunicator(const char* path, int rank, int size, double timeoutSec)
+	: rank(rank), size(size), path(path), listenFd(-1), fds(size, -1) {
+	if (size < 1 || rank < 0 || rank >= size) {
+		cerr << "invalid rank " << rank << " for " << size << " processes" << endl;
+		exit(1);
+	}
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		cerr << "socket path too long: " << path << endl;
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+
+	if (rank == 0) {
+		if (size == 1) return;
+		listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		unlink(path);
+		if (listenFd < 0 || bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, size) != 0) {
+			cerr << "error listening on " << path << ": " << strerror(errno) << endl;
+			exit(1);
+		}
+		//各进程连接后先发送自己的编号
+		for (int i = 1; i < size; i++) {
+			int fd = accept(listenFd, NULL, NULL);
+			if (fd < 0) {
+				cerr << "error accepting connection on " << path << ": " << strerror(errno) << endl;
+				exit(1);
+			}
+			int peer;
+			readAll(fd, &peer, sizeof(peer));
+			if (peer <= 0 || peer >= size || fds[peer] >= 0) {
+				cerr << "unexpected or duplicate rank " << peer << " connected on " << path << endl;
+				exit(1);
+			}
+			fds[peer] = fd;
+		}
+	} else {
+		auto deadline = chrono::steady_clock::now() + chrono::duration<double>(timeoutSec);
+		while (true) {
+			int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (fd < 0) {
+				cerr << "error creating socket: " << strerror(errno) << endl;
+				exit(1);
+			}
+			if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+				fds[0] = fd;
+				break;
+			}
+			close(fd);
+			if (chrono::steady_clock::now() > deadline) {
+				cerr << "timed out connecting to " << path << endl;
+				exit(1);
+			}
+			this_thread::sleep_for(chrono::milliseconds(50));
+		}
+		writeAll(fds[0], &rank, sizeof(rank));
+	}
+}
+
+SocketCommunicator::~SocketCommunicator() {
+	for (size_t i = 0; i < fds.size(); i++) {
+		if (fds[i] >= 0) close(fds[i]);
+	}
+	if (listenFd >= 0) {
+		close(listenFd);
+		unlink(path.c_str());
+	}
+}
+
+void SocketCommunicator::AllReduceSum(double* data, size_t n) {
+	if (size == 1) return;
+	if (rank == 0) {
+		recvBuf.resize(n);
+		for (int i = 1; i < size; i++) {
+			readAll(fds[i], recvBuf.data(), n * sizeof(double));
+			for (size_t j = 0; j < n; j++) {
+				data[j] += recvBuf[j];
+			}
+		}
+		for (int i = 1; i < size; i++) {
+			writeAll(fds[i], data, n * sizeof(double));
+		}
+	} else {
+		writeAll(fds[0], data, n * sizeof(double));
+		readAll(fds[0], data, n * sizeof(double));
+	}
+}
+
+void SocketCommunicator::Broadcast(double* data, size_t n) {
+	if (size == 1) return;
+	if (rank == 0) {
+		for (int i = 1; i < size; i++) {
+			writeAll(fds[i], data, n * sizeof(double));
+		}
+	} else {
+		readAll(fds[0], data, n * sizeof(double));
+	}
+}
+
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//多个进程之间的集合通信，进程编号为0..Size()-1，0号进程是leader
+//所有进程必须以相同的顺序调用相同的集合操作，n也必须相同
+struct Communicator {
+	virtual int Rank() const = 0;
+	virtual int Size() const = 0;
+	//各进程的data按元素求和，结果写回每个进程的data；求和按进程编号的顺序进行，所以结果可复现
+	virtual void AllReduceSum(double* data, size_t n) = 0;
+	//把0号进程的data复制到其余进程
+	virtual void Broadcast(double* data, size_t n) = 0;
+	virtual ~Communicator() { }
+};
+
+//用Unix domain socket在同一台机器上的进程之间通信，用于测试和单机多进程训练
+//星形连接：0号进程在path上监听，其余进程连接到它；AllReduceSum由0号进程收齐各进程的数据、求和后再发回
+class SocketCommunicator : public Communicator {
+	int rank, size;
+	std::string path;
+	int listenFd;
+	std::vector<int> fds; //0号进程：到各进程的连接（fds[0]不用）；其余进程：fds[0]为到0号进程的连接
+	std::vector<double> recvBuf;
+
+	SocketCommunicator(const SocketCommunicator&);
+	SocketCommunicator& operator=(const SocketCommunicator&);
+
+public:
+	//0号进程等待其余size-1个进程都连接上才返回；其余进程在0号进程开始监听之前会不断重试，最多timeoutSec秒
+	SocketCommunicator(const char* path, int rank, int size, double timeoutSec = 60);
+	~SocketCommunicator();
+
+	int Rank() const { return rank; }
+	int Size() const { return size; }
+	void AllReduceSum(double* data, size_t n);
+	void Broadcast(double* data, size_t n);
+};
@@ -0,0 +1,140 @@
+#include "crossValidation.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+//只在一部分样本上计算的逻辑回归目标函数，每个训练任务一个，LogisticRegressionObjective中的缓冲不在任务之间共享
+struct FoldObjective : public DifferentiableFunction {
+	LogisticRegressionObjective objective;
+	const vector<size_t>& rows;
+
+	FoldObjective(const LogisticRegressionProblem& problem, const vector<size_t>& rows, double l2weight, int numThreads)
+		: objective(problem, l2weight, numThreads), rows(rows) { }
+
+	double Eval(const DblVec& input, DblVec& gradient) {
+		return objective.EvalRows(input, gradient, rows.data(), rows.size(), 1.0);
+	}
+};
+
+//各fold结果的平均值和（样本）标准差
+void meanStd(const double* vals, int n, double& mean, double& std) {
+	mean = 0;
+	for (int i = 0; i < n; i++) mean += vals[i];
+	mean /= n;
+	double var = 0;
+	for (int i = 0; i < n; i++) var += (vals[i] - mean) * (vals[i] - mean);
+	std = (n > 1) ? sqrt(var / (n - 1)) : 0;
+}
+
+}
+
+CrossValidation::CrossValidation(const LogisticRegressionProblem& problem, int numFolds, unsigned seed)
+	: problem(problem), numFolds(numFolds), trainRows(numFolds), testRows(numFolds) {
+	size_t n = problem.NumInstances();
+	if (numFolds < 2 || (size_t)numFolds > n) {
+		cerr << "number of folds must be between 2 and the number of instances (" << n << ")" << endl;
+		exit(1);
+	}
+	vector<size_t> perm(n);
+	for (size_t i = 0; i < n; i++) perm[i] = i;
+	mt19937 rng(seed);
+	shuffle(perm.begin(), perm.end(), rng);
+	vector<int> foldOf(n);
+	for (int f = 0; f < numFolds; f++) {
+		for (size_t k = n * f / numFolds; k < n * (f + 1) / numFolds; k++) foldOf[perm[k]] = f;
+	}
+	//按样本顺序收集，训练时按顺序访问样本矩阵
+	for (size_t i = 0; i < n; i++) {
+		for (int f = 0; f < numFolds; f++) {
+			if (foldOf[i] == f) testRows[f].push_back(i);
+			else trainRows[f].push_back(i);
+		}
+	}
+}
+
+double CrossValidation::LogLoss(const DblVec& weights, const vector<size_t>& rows) const {
+	double loss = 0;
+	for (size_t k = 0; k < rows.size(); k++) {
+		double score = problem.ScoreOf(rows[k], weights);
+		loss += (score < -30) ? -score : log(1.0 + exp(-score));
+	}
+	return loss / rows.size();
+}
+
+//AUC = 正样本排在负样本之前的概率：按score排序后用正样本的秩和计算，score相同的样本取平均秩
+double CrossValidation::Auc(const DblVec& weights, const vector<size_t>& rows) const {
+	vector<pair<double, bool> > scored(rows.size());
+	size_t numPos = 0;
+	for (size_t k = 0; k < rows.size(); k++) {
+		scored[k].first = problem.ScoresOf(rows[k], weights.data());
+		scored[k].second = problem.LabelOf(rows[k]);
+		if (scored[k].second) numPos++;
+	}
+	size_t numNeg = rows.size() - numPos;
+	if (numPos == 0 || numNeg == 0) return numeric_limits<double>::quiet_NaN();
+
+	sort(scored.begin(), scored.end());
+	double posRankSum = 0;
+	for (size_t k = 0; k < scored.size(); ) {
+		size_t end = k;
+		size_t tiedPos = 0;
+		while (end < scored.size() && scored[end].first == scored[k].first) {
+			if (scored[end].second) tiedPos++;
+			end++;
+		}
+		//秩从1开始，[k, end)的平均秩为(k + 1 + end) / 2
+		posRankSum += tiedPos * 0.5 * (k + 1 + end);
+		k = end;
+	}
+	return (posRankSum - 0.5 * numPos * (numPos + 1)) / ((double)numPos * numNeg);
+}
+
+void CrossValidation::Run(const vector<CVConfig>& configs, int numThreads, int threadsPerSolve,
+	const function<void(OWLQN&)>& configure, vector<CVResult>& results) const {
+	size_t numTasks = configs.size() * numFolds;
+	vector<double> losses(numTasks), aucs(numTasks), nonZeros(numTasks);
+	int workers = max(1, numThreads / max(1, threadsPerSolve));
+
+	ParallelTasks(workers, numTasks, [&](int, size_t task) {
+		const CVConfig& config = configs[task / numFolds];
+		int fold = (int)(task % numFolds);
+		FoldObjective obj(problem, trainRows[fold], config.l2weight, threadsPerSolve);
+		OWLQN opt(true);
+		configure(opt);
+		DblVec init(problem.NumFeats()), weights(problem.NumFeats());
+		opt.Minimize(obj, init, weights, config.l1weight, config.tol, config.m);
+
+		losses[task] = LogLoss(weights, testRows[fold]);
+		aucs[task] = Auc(weights, testRows[fold]);
+		nonZeros[task] = (double)(weights.size() - count(weights.begin(), weights.end(), 0.0));
+	});
+
+	results.resize(configs.size());
+	for (size_t c = 0; c < configs.size(); c++) {
+		CVResult& r = results[c];
+		r.config = configs[c];
+		double nzStd;
+		meanStd(&losses[c * numFolds], numFolds, r.logLoss, r.logLossStd);
+		meanStd(&aucs[c * numFolds], numFolds, r.auc, r.aucStd);
+		meanStd(&nonZeros[c * numFolds], numFolds, r.nonZeros, nzStd);
+	}
+}
+
+void WriteCVResults(ostream& out, const vector<CVResult>& results) {
+	out << "l1weight\tl2weight\tm\ttol\tlogloss\tlogloss_std\tauc\tauc_std\tnonzeros" << endl;
+	for (size_t c = 0; c < results.size(); c++) {
+		const CVResult& r = results[c];
+		out << setprecision(6) << r.config.l1weight << "\t" << r.config.l2weight << "\t" << r.config.m << "\t" << r.config.tol << "\t"
+			<< r.logLoss << "\t" << r.logLossStd << "\t" << r.auc << "\t" << r.aucStd << "\t" << r.nonZeros << endl;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <ostream>
+
+#include "OWLQN.h"
+#include "logreg.h"
+
+//一组超参数
+struct CVConfig {
+	double l1weight, l2weight, tol;
+	int m;
+};
+
+//一组超参数在各个fold上的平均结果（及标准差）：留出样本的平均log-loss和AUC，模型的非零参数个数
+struct CVResult {
+	CVConfig config;
+	double logLoss, logLossStd;
+	double auc, aucStd;
+	double nonZeros;
+};
+
+//逻辑回归的k折交叉验证：数据只读入一次，各fold只是样本下标的列表，训练时通过EvalRows只计算训练样本，不复制数据
+//每个（超参数，fold）的训练相互独立，在线程池中同时进行
+class CrossValidation {
+	const LogisticRegressionProblem& problem;
+	int numFolds;
+	std::vector<std::vector<size_t> > trainRows, testRows; //各fold的训练样本和留出样本（升序）
+
+public:
+	//样本按seed随机打乱后平均分成numFolds份
+	CrossValidation(const LogisticRegressionProblem& problem, int numFolds, unsigned seed = 1);
+
+	//对每组超参数和每个fold训练一个模型，在留出样本上评估
+	//numThreads为总的线程数，每次训练计算目标函数用threadsPerSolve个线程，所以同时进行numThreads / threadsPerSolve个训练
+	//configure用来设置每次训练新建的OWLQN（compact、线性查找等），训练总是静默的
+	void Run(const std::vector<CVConfig>& configs, int numThreads, int threadsPerSolve,
+		const std::function<void(OWLQN&)>& configure, std::vector<CVResult>& results) const;
+
+	//rows中样本的平均log-loss和AUC（没有正样本或负样本时AUC为NaN）
+	double LogLoss(const DblVec& weights, const std::vector<size_t>& rows) const;
+	double Auc(const DblVec& weights, const std::vector<size_t>& rows) const;
+};
+
+//每组超参数一行，以tab分隔
+void WriteCVResults(std::ostream& out, const std::vector<CVResult>& results);
@@ -0,0 +1,66 @@
+#include "distributed.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+//广播的第一个数是命令，其后是参数
+static const double kStop = 0, kEval = 1;
+
+//leader广播维度，各进程比较后对不一致的个数求和，不一致时所有进程一起退出
+static void checkDim(Communicator& comm, size_t dim) {
+	double leaderDim = (double)dim;
+	comm.Broadcast(&leaderDim, 1);
+	double mismatch = (leaderDim != (double)dim) ? 1 : 0;
+	if (mismatch > 0) {
+		cerr << "process " << comm.Rank() << " has " << dim << " features but process 0 has " << (size_t)leaderDim << endl;
+	}
+	comm.AllReduceSum(&mismatch, 1);
+	if (mismatch > 0) {
+		cerr << "feature dimensions differ between processes" << endl;
+		exit(1);
+	}
+}
+
+DistributedObjective::DistributedObjective(DifferentiableFunction& local, Communicator& comm, size_t dim)
+	: local(local), comm(comm), dim(dim), buf(dim + 1) {
+	checkDim(comm, dim);
+}
+
+double DistributedObjective::Eval(const DblVec& input, DblVec& gradient) {
+	buf[0] = kEval;
+	copy(input.begin(), input.end(), buf.begin() + 1);
+	comm.Broadcast(buf.data(), dim + 1);
+
+	buf[0] = local.Eval(input, gradient);
+	copy(gradient.begin(), gradient.end(), buf.begin() + 1);
+	comm.AllReduceSum(buf.data(), dim + 1);
+	copy(buf.begin() + 1, buf.end(), gradient.begin());
+	return buf[0];
+}
+
+void DistributedObjective::Finish(const DblVec& x) {
+	buf[0] = kStop;
+	copy(x.begin(), x.end(), buf.begin() + 1);
+	comm.Broadcast(buf.data(), dim + 1);
+}
+
+void ServeDistributed(DifferentiableFunction& local, Communicator& comm, size_t dim, DblVec& result, double constant) {
+	checkDim(comm, dim);
+	vector<double> buf(dim + 1);
+	DblVec input(dim), gradient(dim);
+	while (true) {
+		comm.Broadcast(buf.data(), dim + 1);
+		copy(buf.begin() + 1, buf.end(), input.begin());
+		if (buf[0] == kStop) {
+			result = input;
+			return;
+		}
+
+		buf[0] = local.Eval(input, gradient) - constant;
+		copy(gradient.begin(), gradient.end(), buf.begin() + 1);
+		comm.AllReduceSum(buf.data(), dim + 1);
+	}
+}
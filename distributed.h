@@ -0,0 +1,28 @@
+#pragma once
+
+#include "OWLQN.h"
+#include "communicator.h"
+
+//数据并行的分布式训练：每个进程持有一部分样本，用自己的DifferentiableFunction计算这部分样本的损失和梯度
+//0号进程（leader）运行OWLQN，目标函数为DistributedObjective：每次Eval把参数广播给其余进程，
+//各进程计算自己的部分后用AllReduceSum求和；其余进程在ServeDistributed中响应，直到leader调用Finish
+//l2正则化项只应由leader的目标函数计算，其余进程的目标函数使用l2weight = 0
+
+//leader一侧的目标函数，构造时与各进程核对参数的维度
+class DistributedObjective : public DifferentiableFunction {
+	DifferentiableFunction& local;
+	Communicator& comm;
+	const size_t dim;
+	std::vector<double> buf; //命令和参数，或者损失和梯度
+
+public:
+	DistributedObjective(DifferentiableFunction& local, Communicator& comm, size_t dim);
+
+	double Eval(const DblVec& input, DblVec& gradient);
+	//通知其余进程训练结束，并把最终的参数x发给它们
+	void Finish(const DblVec& x);
+};
+
+//其余进程的主循环：按leader的广播计算本地的损失和梯度，直到leader调用Finish，result为最终的参数
+//local的函数值中包含的常数constant（逻辑回归和最小二乘的目标函数都加了1）在求和之前减去，只保留leader的一份
+void ServeDistributed(DifferentiableFunction& local, Communicator& comm, size_t dim, DblVec& result, double constant = 1.0);
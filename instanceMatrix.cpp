@@ -0,0 +1,203 @@
+#include "instanceMatrix.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+InstanceMatrix::InstanceMatrix(size_t numCols) : layout(Undecided), numCols(numCols), numRows(0), numNonZeros(0), external(false) {
+	wideIndices = (uint64_t)numCols > 0xFFFFFFFFull;
+	UpdateViews();
+}
+
+InstanceMatrix::InstanceMatrix(const InstanceMatrix& other) {
+	*this = other;
+}
+
+InstanceMatrix& InstanceMatrix::operator=(const InstanceMatrix& other) {
+	layout = other.layout;
+	numCols = other.numCols;
+	numRows = other.numRows;
+	wideIndices = other.wideIndices;
+	rowStarts = other.rowStarts;
+	indices32 = other.indices32;
+	indices64 = other.indices64;
+	values = other.values;
+	rowStartsView = other.rowStartsView;
+	indices32View = other.indices32View;
+	indices64View = other.indices64View;
+	valuesView = other.valuesView;
+	numNonZeros = other.numNonZeros;
+	external = other.external;
+	backing = other.backing;
+	if (!external) UpdateViews();
+	return *this;
+}
+
+//自己持有数组时，view指向各个vector（vector增长后需要重新设置）
+void InstanceMatrix::UpdateViews() {
+	rowStartsView = rowStarts.data();
+	indices32View = indices32.data();
+	indices64View = indices64.data();
+	valuesView = values.data();
+	numNonZeros = values.size();
+}
+
+void InstanceMatrix::Attach(Layout l, size_t rows, size_t nonZeros, const uint64_t* starts, const void* inds, const float* vals, shared_ptr<const void> keepAlive) {
+	layout = l;
+	numRows = rows;
+	numNonZeros = nonZeros;
+	rowStarts.clear();
+	indices32.clear();
+	indices64.clear();
+	values.clear();
+	rowStartsView = starts;
+	indices32View = wideIndices ? NULL : (const uint32_t*)inds;
+	indices64View = wideIndices ? (const uint64_t*)inds : NULL;
+	valuesView = vals;
+	external = true;
+	backing = keepAlive;
+}
+
+void InstanceMatrix::AdoptSparse(size_t rows, vector<uint64_t>& starts, vector<uint32_t>& inds, vector<float>& vals) {
+	if (wideIndices) {
+		cerr << "matrix with " << numCols << " columns needs 64-bit indices" << endl;
+		exit(1);
+	}
+	SetLayout(Sparse);
+	rowStarts.swap(starts);
+	indices32.swap(inds);
+	values.swap(vals);
+	numRows = rows;
+	UpdateViews();
+}
+
+void InstanceMatrix::AdoptSparse(size_t rows, vector<uint64_t>& starts, vector<uint64_t>& inds, vector<float>& vals) {
+	if (!wideIndices) {
+		cerr << "matrix with " << numCols << " columns uses 32-bit indices" << endl;
+		exit(1);
+	}
+	SetLayout(Sparse);
+	rowStarts.swap(starts);
+	indices64.swap(inds);
+	values.swap(vals);
+	numRows = rows;
+	UpdateViews();
+}
+
+void InstanceMatrix::AdoptDense(size_t rows, vector<float>& vals) {
+	SetLayout(Dense);
+	values.swap(vals);
+	numRows = rows;
+	UpdateViews();
+}
+
+//第一个样本决定存储格式，稀疏和稠密样本不能混用
+void InstanceMatrix::SetLayout(Layout l) {
+	if (external) {
+		cerr << "cannot add instances to a matrix backed by external memory" << endl;
+		exit(1);
+	}
+	if (layout == l) return;
+	if (layout != Undecided) {
+		cerr << "cannot mix sparse and dense instances in one matrix" << endl;
+		exit(1);
+	}
+	layout = l;
+	if (layout == Sparse) rowStarts.push_back(0);
+	UpdateViews();
+}
+
+//稀疏行中在cols里的元素按新的列号写出，列号用二分查找得到，不需要与原特征维度一样长的映射表
+template <class Src, class Dst>
+static void selectSparse(const uint64_t* starts, const Src* inds, const float* vals, size_t numRows, const vector<size_t>& cols,
+	vector<uint64_t>& newStarts, vector<Dst>& newInds, vector<float>& newVals) {
+	newStarts.assign(1, 0);
+	newStarts.reserve(numRows + 1);
+	for (size_t i = 0; i < numRows; i++) {
+		for (uint64_t j = starts[i]; j < starts[i + 1]; j++) {
+			vector<size_t>::const_iterator it = lower_bound(cols.begin(), cols.end(), (size_t)inds[j]);
+			if (it != cols.end() && *it == inds[j]) {
+				newInds.push_back((Dst)(it - cols.begin()));
+				newVals.push_back(vals[j]);
+			}
+		}
+		newStarts.push_back(newVals.size());
+	}
+}
+
+InstanceMatrix InstanceMatrix::SelectColumns(const vector<size_t>& cols) const {
+	InstanceMatrix sub(cols.size());
+	if (layout == Dense) {
+		vector<float> vals(numRows * cols.size());
+		for (size_t i = 0; i < numRows; i++) {
+			const float* row = valuesView + i * numCols;
+			for (size_t k = 0; k < cols.size(); k++) vals[i * cols.size() + k] = row[cols[k]];
+		}
+		sub.AdoptDense(numRows, vals);
+	} else if (layout == Sparse) {
+		vector<uint64_t> starts;
+		vector<float> vals;
+		if (sub.wideIndices) {
+			vector<uint64_t> inds;
+			selectSparse(rowStartsView, indices64View, valuesView, numRows, cols, starts, inds, vals);
+			sub.AdoptSparse(numRows, starts, inds, vals);
+		} else {
+			vector<uint32_t> inds;
+			if (wideIndices) selectSparse(rowStartsView, indices64View, valuesView, numRows, cols, starts, inds, vals);
+			else selectSparse(rowStartsView, indices32View, valuesView, numRows, cols, starts, inds, vals);
+			sub.AdoptSparse(numRows, starts, inds, vals);
+		}
+	}
+	return sub;
+}
+
+InstanceMatrix InstanceMatrix::SelectRows(size_t begin, size_t end) const {
+	InstanceMatrix sub(numCols);
+	if (layout == Dense) {
+		vector<float> vals(valuesView + begin * numCols, valuesView + end * numCols);
+		sub.AdoptDense(end - begin, vals);
+	} else if (layout == Sparse) {
+		uint64_t first = rowStartsView[begin], last = rowStartsView[end];
+		vector<uint64_t> starts(end - begin + 1);
+		for (size_t i = begin; i <= end; i++) starts[i - begin] = rowStartsView[i] - first;
+		vector<float> vals(valuesView + first, valuesView + last);
+		if (wideIndices) {
+			vector<uint64_t> inds(indices64View + first, indices64View + last);
+			sub.AdoptSparse(end - begin, starts, inds, vals);
+		} else {
+			vector<uint32_t> inds(indices32View + first, indices32View + last);
+			sub.AdoptSparse(end - begin, starts, inds, vals);
+		}
+	}
+	return sub;
+}
+
+void InstanceMatrix::Reserve(size_t rows, size_t nonZeros) {
+	rowStarts.reserve(rows + 1);
+	if (wideIndices) indices64.reserve(nonZeros);
+	else indices32.reserve(nonZeros);
+	values.reserve(nonZeros);
+}
+
+//加入一个稀疏样本：inds为特征维度下标，vals为对应的特征值
+void InstanceMatrix::AddSparseRow(const size_t* inds, const float* vals, size_t count) {
+	SetLayout(Sparse);
+	for (size_t j = 0; j < count; j++) {
+		if (wideIndices) indices64.push_back(inds[j]);
+		else indices32.push_back((uint32_t)inds[j]);
+		values.push_back(vals[j]);
+	}
+	rowStarts.push_back(values.size());
+	numRows++;
+	UpdateViews();
+}
+
+//加入一个稠密样本：vals的长度为numCols
+void InstanceMatrix::AddDenseRow(const float* vals) {
+	SetLayout(Dense);
+	values.insert(values.end(), vals, vals + numCols);
+	numRows++;
+	UpdateViews();
+}
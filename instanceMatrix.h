@@ -0,0 +1,147 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <stdint.h>
+
+#include "vecops.h"
+
+//样本矩阵：每行是一个样本，连续存储
+//稀疏样本按CSR格式存储（行偏移rowStarts、列下标indices、值values），列下标按特征维度选用uint32或uint64
+//稠密样本按行优先存储在values中，第i行为values[i * numCols]到values[(i + 1) * numCols - 1]
+//存储格式在加入第一个样本时确定，之后不再改变，内层循环里没有格式判断
+//数组可以由矩阵自己持有，也可以通过Attach指向外部内存（例如映射到内存的二进制数据集文件），计算时只通过view指针访问
+class InstanceMatrix {
+public:
+	enum Layout { Undecided, Sparse, Dense };
+
+private:
+	Layout layout;
+	size_t numCols, numRows;
+	bool wideIndices; //特征维度超过uint32的范围时使用uint64下标
+	std::vector<uint64_t> rowStarts; //第i行在indices和values中的位置：rowStarts[i]到rowStarts[i+1] - 1
+	std::vector<uint32_t> indices32;
+	std::vector<uint64_t> indices64;
+	std::vector<float> values;
+
+	const uint64_t* rowStartsView;
+	const uint32_t* indices32View;
+	const uint64_t* indices64View;
+	const float* valuesView;
+	size_t numNonZeros;
+	bool external; //数组是否在外部内存中
+	std::shared_ptr<const void> backing; //保证外部内存在矩阵使用期间有效
+
+	void UpdateViews();
+
+	template <class Index>
+	static double sparseDot(const Index* inds, const float* vals, size_t count, const double* w) {
+		double score = 0;
+		for (size_t j = 0; j < count; j++) {
+			score += w[inds[j]] * vals[j];
+		}
+		return score;
+	}
+
+	template <class Index>
+	static void sparseAddMult(const Index* inds, const float* vals, size_t count, double mult, double* vec) {
+		for (size_t j = 0; j < count; j++) {
+			vec[inds[j]] += mult * vals[j];
+		}
+	}
+
+	//一次遍历同时算两个内积
+	template <class Index>
+	static void sparseDot2(const Index* inds, const float* vals, size_t count, const double* w1, const double* w2, double& s1, double& s2) {
+		double a = 0, b = 0;
+		for (size_t j = 0; j < count; j++) {
+			a += w1[inds[j]] * vals[j];
+			b += w2[inds[j]] * vals[j];
+		}
+		s1 = a;
+		s2 = b;
+	}
+
+	static double denseDot(const float* vals, size_t count, const double* w) {
+		double score = 0;
+		for (size_t j = 0; j < count; j++) {
+			score += w[j] * vals[j];
+		}
+		return score;
+	}
+
+	static void denseAddMult(const float* vals, size_t count, double mult, double* vec) {
+		for (size_t j = 0; j < count; j++) {
+			vec[j] += mult * vals[j];
+		}
+	}
+
+	void SetLayout(Layout l);
+
+public:
+	InstanceMatrix(size_t numCols = 0);
+	InstanceMatrix(const InstanceMatrix& other);
+	InstanceMatrix& operator=(const InstanceMatrix& other);
+
+	//直接使用已经构造好的数组，数组的内容被交换进来，不做拷贝
+	void AdoptSparse(size_t numRows, std::vector<uint64_t>& rowStarts, std::vector<uint32_t>& indices, std::vector<float>& values);
+	void AdoptSparse(size_t numRows, std::vector<uint64_t>& rowStarts, std::vector<uint64_t>& indices, std::vector<float>& values);
+	void AdoptDense(size_t numRows, std::vector<float>& values);
+
+	//使用外部的数组，不做拷贝：indices的类型由numCols决定（uint32或uint64），稠密格式时rowStarts和indices为NULL
+	void Attach(Layout layout, size_t numRows, size_t numNonZeros, const uint64_t* rowStarts, const void* indices, const float* values, std::shared_ptr<const void> backing);
+
+	//只保留cols中的列（升序），第k列为原来的第cols[k]列；结果持有自己的数组
+	InstanceMatrix SelectColumns(const std::vector<size_t>& cols) const;
+	//只保留第begin到end - 1行；结果持有自己的数组，数组在调用的线程中分配和写入
+	InstanceMatrix SelectRows(size_t begin, size_t end) const;
+
+	void Reserve(size_t rows, size_t nonZeros);
+	void AddSparseRow(const size_t* inds, const float* vals, size_t count);
+	void AddDenseRow(const float* vals);
+
+	//第i行与w的内积
+	double Dot(size_t i, const double* w) const {
+		if (layout == Dense) {
+			return denseDot(valuesView + i * numCols, numCols, w);
+		}
+		size_t start = rowStartsView[i], count = rowStartsView[i + 1] - start;
+		if (wideIndices) return sparseDot(indices64View + start, valuesView + start, count, w);
+		return sparseDot(indices32View + start, valuesView + start, count, w);
+	}
+
+	//s1 = 第i行与w1的内积，s2 = 第i行与w2的内积：稀疏行只遍历一次，稠密行第二次从cache中读
+	void Dot2(size_t i, const double* w1, const double* w2, double& s1, double& s2) const {
+		if (layout == Dense) {
+			s1 = VecDotFloat(valuesView + i * numCols, w1, numCols);
+			s2 = VecDotFloat(valuesView + i * numCols, w2, numCols);
+			return;
+		}
+		size_t start = rowStartsView[i], count = rowStartsView[i + 1] - start;
+		if (wideIndices) sparseDot2(indices64View + start, valuesView + start, count, w1, w2, s1, s2);
+		else sparseDot2(indices32View + start, valuesView + start, count, w1, w2, s1, s2);
+	}
+
+	//vec += mult * 第i行
+	void AddMultTo(size_t i, double mult, double* vec) const {
+		if (layout == Dense) {
+			denseAddMult(valuesView + i * numCols, numCols, mult, vec);
+			return;
+		}
+		size_t start = rowStartsView[i], count = rowStartsView[i + 1] - start;
+		if (wideIndices) sparseAddMult(indices64View + start, valuesView + start, count, mult, vec);
+		else sparseAddMult(indices32View + start, valuesView + start, count, mult, vec);
+	}
+
+	Layout GetLayout() const { return layout; }
+	size_t NumRows() const { return numRows; }
+	size_t NumCols() const { return numCols; }
+	size_t NumNonZeros() const { return numNonZeros; }
+	size_t IndexBytes() const { return wideIndices ? 8 : 4; }
+
+	//底层数组，用于写二进制数据集
+	const uint64_t* RowStartsData() const { return rowStartsView; }
+	const void* IndicesData() const { return wideIndices ? (const void*)indices64View : (const void*)indices32View; }
+	const float* ValuesData() const { return valuesView; }
+};
@@ -1,104 +1,289 @@
 #include "leastSquares.h"
+#include "binaryData.h"
+#include "instanceMatrix.h"
+#include "matrixMarket.h"
+#include "parallel.h"
+#include "vecops.h"
 
-#include <fstream>
-#include <sstream>
-#include <string>
+#include <algorithm>
+#include <cstring>
 
 using namespace std;
 
-LeastSquaresProblem::LeastSquaresProblem(const char* matFilename, const char* bFilename) {
-	ifstream matfile(matFilename);
-	if (!matfile.good()) {
+LeastSquaresProblem::LeastSquaresProblem(const char* matFilename, const char* bFilename, int numThreads) : sparse(false), m(0), n(0), AView(NULL), bView(NULL) {
+	if (IsBinaryDataFile(matFilename)) {
+		LoadBinary(matFilename);
+		return;
+	}
+
+	MatrixMarketHeader header;
+	if (!ReadMatrixMarketHeader(matFilename, header)) {
 		cerr << "error opening matrix file " << matFilename << endl;
 		exit(1);
 	}
-
-	string s;
-	getline(matfile, s);
-	if (!s.compare("%%MatrixMarket matrix array real general")) {
-		skipEmptyAndComment(matfile, s);
-		stringstream st(s);
-		st >> m >> n;
-		Amat.resize(m * n);
-
-		for (size_t j=0; j<n; j++) {
-			for (size_t i=0; i<m; i++) {
-				float val;
-				matfile >> val;
-				A(i, j) = val;
-			}
+	m = header.rows;
+	n = header.cols;
+	if (header.format == MatrixMarketHeader::Array) {
+		//文件中按列存储，与Amat的存储顺序相同
+		ReadMatrixMarketArray(matFilename, header, numThreads, Amat);
+	} else if (header.format == MatrixMarketHeader::Coordinate) {
+		//稀疏矩阵：直接读成CSR，每行是一个样本
+		sparse = true;
+		sparseA = InstanceMatrix(n);
+		vector<uint64_t> rowStarts;
+		vector<float> values;
+		if (sparseA.IndexBytes() == 4) {
+			vector<uint32_t> indices;
+			ReadMatrixMarketCoordinate(matFilename, header, numThreads, rowStarts, indices, values);
+			sparseA.AdoptSparse(m, rowStarts, indices, values);
+		} else {
+			vector<uint64_t> indices;
+			ReadMatrixMarketCoordinate(matFilename, header, numThreads, rowStarts, indices, values);
+			sparseA.AdoptSparse(m, rowStarts, indices, values);
 		}
-
-		matfile.close();
 	} else {
-		matfile.close();
-		cerr << "Unsupported matrix format \"" << s << "\" in " << matFilename << endl;
+		cerr << "Unsupported matrix format \"" << header.banner << "\" in " << matFilename << endl;
 		exit(1);
 	}
 
-	ifstream bFile(bFilename);
-	if (!bFile.good()) {
+	MatrixMarketHeader bHeader;
+	if (!ReadMatrixMarketHeader(bFilename, bHeader)) {
 		cerr << "error opening y-value file " << bFilename << endl;
 		exit(1);
 	}
-	getline(bFile, s);
-	if (s.compare("%%MatrixMarket matrix array real general")) {
-		bFile.close();
-		cerr << "unsupported y-value file format \"" << s << "\" in " << bFilename << endl;
+	if (bHeader.format != MatrixMarketHeader::Array) {
+		cerr << "unsupported y-value file format \"" << bHeader.banner << "\" in " << bFilename << endl;
 		exit(1);
 	}
-
-	skipEmptyAndComment(bFile, s);
-	stringstream bst(s);
-	size_t bNum, bCol;
-	bst >> bNum >> bCol;
-	if (bNum != m) {
+	if (bHeader.rows != m) {
 		cerr << "number of y-values doesn't match number of instances in " << bFilename << endl;
 		exit(1);
-	} else if (bCol != 1) {
+	} else if (bHeader.cols != 1) {
 		cerr << "y-value matrix may not have more than one column" << endl;
 		exit(1);
 	}
+	ReadMatrixMarketArray(bFilename, bHeader, numThreads, b);
+
+	AView = Amat.data();
+	bView = b.data();
+}
+
+//映射二进制数据集，A和b都直接使用映射的内存
+void LeastSquaresProblem::LoadBinary(const char* filename) {
+	const BinaryDataHeader* h;
+	shared_ptr<MappedFile> file = MapBinaryData(filename, LeastSquaresData, h);
+	m = h->numRows;
+	n = h->numCols;
+	const char* base = file->Data();
+	if (h->layout == InstanceMatrix::Sparse) {
+		sparse = true;
+		sparseA = InstanceMatrix(n);
+		if (m > 0 && sparseA.IndexBytes() != h->indexBytes) {
+			cerr << "unexpected index width in binary data file " << filename << endl;
+			exit(1);
+		}
+		sparseA.Attach(InstanceMatrix::Sparse, m, h->numNonZeros, (const uint64_t*)(base + h->rowStartsOffset), base + h->indicesOffset, (const float*)(base + h->valuesOffset), file);
+	} else {
+		AView = (const float*)(base + h->valuesOffset);
+	}
+	bView = (const float*)(base + h->labelsOffset);
+	backing = file;
+}
+
+void LeastSquaresProblem::WriteBinary(const char* filename) const {
+	BinaryDataHeader h;
+	memset(&h, 0, sizeof(h));
+	h.kind = LeastSquaresData;
+	h.numRows = m;
+	h.numCols = n;
+	if (sparse) {
+		h.layout = InstanceMatrix::Sparse;
+		h.indexBytes = (uint32_t)sparseA.IndexBytes();
+		h.numNonZeros = sparseA.NumNonZeros();
+		static const uint64_t emptyStarts = 0;
+		const uint64_t* starts = (m > 0) ? sparseA.RowStartsData() : &emptyStarts;
+		WriteBinaryData(filename, h, starts, sparseA.IndicesData(), sparseA.ValuesData(), bView);
+		return;
+	}
+	h.layout = InstanceMatrix::Dense;
+	h.numNonZeros = m * n;
+	WriteBinaryData(filename, h, NULL, NULL, AView, bView);
+}
+
+LeastSquaresProblem::LeastSquaresProblem(const char* textFile, int hashBits, bool signedHash, int numThreads)
+	: sparseA((size_t)1 << hashBits), sparse(true), m(0), n((size_t)1 << hashBits) {
+	vector<uint64_t> rowStarts;
+	vector<uint32_t> indices;
+	vector<float> values;
+	ReadHashedText(textFile, hashBits, signedHash, numThreads, rowStarts, indices, values, b);
+	m = b.size();
+	sparseA.AdoptSparse(m, rowStarts, indices, values);
+	AView = Amat.data();
+	bView = b.data();
+}
+
+LeastSquaresProblem::LeastSquaresProblem(size_t n, vector<uint64_t>& rowStarts, vector<uint32_t>& indices, vector<float>& values, vector<float>& bVals)
+	: sparseA(n), sparse(true), m(bVals.size()), n(n) {
+	if (rowStarts.size() != m + 1) {
+		cerr << "sparse least squares data needs one row per label" << endl;
+		exit(1);
+	}
+	b.swap(bVals);
+	sparseA.AdoptSparse(m, rowStarts, indices, values);
+	AView = Amat.data();
+	bView = b.data();
+}
 
-	b.resize(m);
-	for (size_t i=0; i<m; i++) {
-		float val;
-		bFile >> val;
-		b[i] = val;
+LeastSquaresProblem::LeastSquaresProblem(const LeastSquaresProblem& other, const vector<size_t>& cols)
+	: sparseA(cols.size()), sparse(other.sparse), b(other.bView, other.bView + other.m), m(other.m), n(cols.size()) {
+	if (sparse) {
+		sparseA = other.sparseA.SelectColumns(cols);
+	} else {
+		//按列存储，每列连续复制
+		Amat.resize(m * n);
+		for (size_t k = 0; k < n; k++) {
+			memcpy(&Amat[k * m], other.AView + cols[k] * m, m * sizeof(float));
+		}
 	}
-	bFile.close();
+	AView = Amat.data();
+	bView = b.data();
 }
 
 
-double LeastSquaresObjective::Eval(const DblVec& input, DblVec& gradient) {
-	static DblVec temp(problem.m);
+//行块的大小：一块残差（16KB）和当前的列段能同时留在L1/L2中
+static const size_t kRowBlock = 2048;
 
+double LeastSquaresObjective::Eval(const DblVec& input, DblVec& gradient) {
 	if (input.size() != problem.n) {
 		cerr << "Error: input is not the correct size." << endl;
 		exit(1);
 	}
 
-	for (size_t i=0; i<problem.m; i++) {
-		temp[i] = -problem.b[i];
+	if (problem.sparse) return EvalSparse(input, gradient);
+
+	size_t m = problem.m, n = problem.n;
+	const float* A = problem.AView;
+	size_t numBlocks = (m + kRowBlock - 1) / kRowBlock;
+	residual.resize(m);
+	activeBlocks.assign(numBlocks, 0);
+
+	double value = 0.0;
+	activeCols.clear();
+	for (size_t j=0; j<n; j++) {
+		value += input[j] * input[j] * l2weight;
+		//L1正则化使很多参数为0，跳过这些列可以少读整列的数据
+		if (input[j] != 0) activeCols.push_back(j);
 	}
 
+	//r = A * input - b，各线程的平方和按固定顺序相加
+	std::vector<double> sqSums(numThreads, 0.0);
+	ParallelFor(numThreads, numBlocks, [&](int t, size_t begin, size_t end) {
+		for (size_t blk = begin; blk < end; blk++) {
+			size_t i0 = blk * kRowBlock, len = min(kRowBlock, m - i0);
+			double* r = &residual[i0];
+			for (size_t i = 0; i < len; i++) {
+				r[i] = -problem.B(i0 + i);
+			}
+			for (size_t k = 0; k < activeCols.size(); k++) {
+				size_t j = activeCols[k];
+				VecAddMultFloat(r, A + m * j + i0, input[j], len);
+			}
+			double sq = VecDot(r, r, len);
+			activeBlocks[blk] = (sq != 0);
+			sqSums[t] += sq;
+		}
+	});
+	value += TreeSum(sqSums);
+
+	//gradient = A' * r + l2weight * input，各线程负责一段列，不需要归约
+	//残差为0的行块（拟合得很好时常见）对梯度没有贡献，整块跳过；单个残差为0的行不再单独判断
+	ParallelFor(numThreads, n, [&](int, size_t begin, size_t end) {
+		for (size_t j = begin; j < end; j++) {
+			gradient[j] = l2weight * input[j];
+		}
+		for (size_t blk = 0; blk < numBlocks; blk++) {
+			if (!activeBlocks[blk]) continue;
+			size_t i0 = blk * kRowBlock, len = min(kRowBlock, m - i0);
+			const double* r = &residual[i0];
+			for (size_t j = begin; j < end; j++) {
+				gradient[j] += VecDotFloat(A + m * j + i0, r, len);
+			}
+		}
+	});
+
+	return 0.5 * value + 1.0;
+}
+
+//稀疏的A：按行计算残差，残差为0的行不需要更新梯度
+double LeastSquaresObjective::EvalSparse(const DblVec& input, DblVec& gradient) {
+	const InstanceMatrix& A = problem.sparseA;
+
 	double value = 0.0;
 	for (size_t j=0; j<problem.n; j++) {
 		value += input[j] * input[j] * l2weight;
 		gradient[j] = l2weight * input[j];
-		for (size_t i=0; i<problem.m; i++) {
-			temp[i] += input[j] * problem.A(i,j);
+	}
+
+	if (columnsReady < 0) {
+		columnsReady = UseColumnGradient(gradientMode, A, numThreads) ? 1 : 0;
+		if (columnsReady) {
+			columns.reset(new ColumnMatrix(A));
+			columnBounds = columns->Partition(numThreads);
+			vector<DblVec>().swap(threadGrads);
+		} else {
+			columns.reset();
 		}
 	}
 
-	for (size_t i=0; i<problem.m; i++) {
-		if (temp[i] == 0) continue;
+	std::vector<double> sqSums(numThreads, 0.0);
+	if (columnsReady) {
+		//按列计算：先按行算出残差，再由各线程各自负责一段特征的梯度
+		residual.resize(problem.m);
+		ParallelFor(numThreads, problem.m, [&](int t, size_t begin, size_t end) {
+			double sq = 0;
+			for (size_t i = begin; i < end; i++) {
+				double r = A.Dot(i, &input[0]) - problem.B(i);
+				residual[i] = r;
+				sq += r * r;
+			}
+			sqSums[t] = sq;
+		});
+		ParallelFor(numThreads, (size_t)numThreads, [&](int, size_t begin, size_t end) {
+			for (size_t t = begin; t < end; t++) {
+				columns->AddTransposeMult(&residual[0], 1.0, &gradient[0], columnBounds[t], columnBounds[t + 1]);
+			}
+		});
+		return 0.5 * (value + TreeSum(sqSums)) + 1.0;
+	}
+
+	threadGrads.resize(numThreads - 1);
+	std::vector<DblVec*> bufs(numThreads);
+	bufs[0] = &gradient;
+	for (int t = 1; t < numThreads; t++) {
+		bufs[t] = &threadGrads[t - 1];
+	}
 
-		value += temp[i] * temp[i];
-		for (size_t j=0; j<problem.n; j++) {
-			gradient[j] += problem.A(i, j) * temp[i];
+	ParallelFor(numThreads, problem.m, [&](int t, size_t begin, size_t end) {
+		if (t > 0) bufs[t]->assign(input.size(), 0.0);
+		double* grad = &(*bufs[t])[0];
+		double sq = 0;
+		for (size_t i = begin; i < end; i++) {
+			double r = A.Dot(i, &input[0]) - problem.B(i);
+			if (r == 0) continue;
+			sq += r * r;
+			A.AddMultTo(i, r, grad);
 		}
-	}
+		sqSums[t] = sq;
+	});
+	if (numThreads > 1) TreeReduce(bufs, input.size(), numThreads);
 
-	return 0.5 * value + 1.0;
+	return 0.5 * (value + TreeSum(sqSums)) + 1.0;
+}
+
+DifferentiableFunction* LeastSquaresObjective::Restrict(const vector<size_t>& cols) const {
+	LeastSquaresProblem* sub = new LeastSquaresProblem(problem, cols);
+	LeastSquaresObjective* obj = new LeastSquaresObjective(*sub, l2weight, numThreads);
+	obj->SetGradientMode(gradientMode);
+	obj->ownedProblem.reset(sub);
+	return obj;
 }
@@ -1,47 +1,98 @@
 #pragma once
 
-#include <fstream>
-#include <string>
+#include <memory>
 
 #include "OWLQN.h"
+#include "instanceMatrix.h"
+#include "columnMatrix.h"
 
 struct LeastSquaresObjective;
 
+//A可以是稠密的（按列存储在Amat中），也可以是稀疏的（每行一个样本，按CSR存储在sparseA中）
+//稀疏格式由coordinate格式的MatrixMarket文件或稀疏的二进制数据集得到，这时A(i,j)不可用
 class LeastSquaresProblem {
 	std::vector<float> Amat;
+	InstanceMatrix sparseA;
+	bool sparse;
 	std::vector<float> b;
 	size_t m, n;
-	
-	void skipEmptyAndComment(std::ifstream& file, std::string& s) {
-		do {
-			std::getline(file, s);
-		} while (s.size() == 0 || s[0] == '%');
-	}
+	//计算时使用的数组：指向Amat和b，或者指向映射到内存的二进制数据集
+	const float* AView;
+	const float* bView;
+	std::shared_ptr<const void> backing;
 
 	friend struct LeastSquaresObjective;
 
+	void LoadBinary(const char* filename);
+
+	LeastSquaresProblem(const LeastSquaresProblem&);
+	LeastSquaresProblem& operator=(const LeastSquaresProblem&);
+
 public:
-	LeastSquaresProblem(size_t m, size_t n) : Amat(m * n), b(m), m(m), n(n) { }
+	LeastSquaresProblem(size_t m, size_t n) : Amat(m * n), sparseA(n), sparse(false), b(m), m(m), n(n), AView(Amat.data()), bView(b.data()) { }
 
-	LeastSquaresProblem(const char* matfile, const char* bFile);
+	//matfile可以是MatrixMarket格式的文件，也可以是二进制数据集（这时bFile不使用）
+	//numThreads为解析MatrixMarket文件的线程数
+	LeastSquaresProblem(const char* matfile, const char* bFile, int numThreads = 1);
+	//libsvm或VW格式的文本数据，特征名hash到2^hashBits维（见ReadHashedText），A是稀疏的，b为各行的label
+	LeastSquaresProblem(const char* textFile, int hashBits, bool signedHash, int numThreads = 1);
+	//稀疏的A（n列，CSR，每行一个样本）和b，数组的内容被交换进来，调用后参数为空
+	LeastSquaresProblem(size_t n, std::vector<uint64_t>& rowStarts, std::vector<uint32_t>& indices, std::vector<float>& values, std::vector<float>& b);
+	//只保留other中cols（升序）这些列的问题，b与other相同
+	LeastSquaresProblem(const LeastSquaresProblem& other, const std::vector<size_t>& cols);
+	//写成二进制数据集
+	void WriteBinary(const char* filename) const;
 
 	float A(size_t i, size_t j) const {
-		return Amat[i + m * j];
+		return AView[i + m * j];
 	}
 
 	float& A(size_t i, size_t j) {
 		return Amat[i + m * j];
 	}
 
+	float B(size_t i) const { return bView[i]; }
+	float& B(size_t i) { return b[i]; }
+
+	bool IsSparse() const { return sparse; }
+
 	size_t NumFeats() const { return n; }
 	size_t NumInstances() const { return m; }
 };
 
-struct LeastSquaresObjective : public DifferentiableFunction {
+//A稠密时按列存储，Eval分两步计算，两步都按行分块，使残差的一块在缓存中时把A的对应部分连续读一遍：
+//  r = A * input - b：各线程负责若干行块，对每个行块依次加上每个非零参数对应的列段
+//  gradient = A' * r + l2weight * input：各线程负责若干列，每个列段与残差块做内积
+//每个梯度分量的加法顺序与线程数无关
+//A稀疏时与逻辑回归相同，按行计算r_i = A_i * input - b_i，再把r_i * A_i加到各线程自己的梯度缓冲上，最后归约；
+//或者先算出残差r，再用A按列存储的副本按列计算A' * r
+struct LeastSquaresObjective : public DifferentiableFunction, public RestrictableFunction {
 	const LeastSquaresProblem& problem;
+	std::unique_ptr<const LeastSquaresProblem> ownedProblem; //Restrict得到的目标函数持有自己的问题
 	const double l2weight;
+	const int numThreads;
+	DblVec residual; //r = A * input - b
+	std::vector<size_t> activeCols; //input中非零的维度，只有这些列参与A * input
+	std::vector<char> activeBlocks; //残差不全为0的行块，只有这些块参与A' * r
+	std::vector<DblVec> threadGrads; //稀疏时第1到numThreads-1个线程的梯度缓冲
+	GradientMode gradientMode;
+	int columnsReady; //-1：还没有决定，0：按行计算梯度，1：按列计算梯度（columns已经构造）
+	std::unique_ptr<ColumnMatrix> columns; //稀疏时按列计算梯度用的A的副本
+	std::vector<size_t> columnBounds; //各线程负责的列
+
+	double EvalSparse(const DblVec& input, DblVec& gradient);
 
-	LeastSquaresObjective(const LeastSquaresProblem& p, double l2weight = 0) : problem(p), l2weight(l2weight) { }
+	LeastSquaresObjective(const LeastSquaresProblem& p, double l2weight = 0, int numThreads = 1)
+		: problem(p), l2weight(l2weight), numThreads(numThreads), gradientMode(AutoGradient), columnsReady(-1) { }
+
+	//A稀疏时梯度A' * r的并行计算方式（见GradientMode）；A稠密时总是按上面的列段计算
+	void SetGradientMode(GradientMode mode) {
+		gradientMode = mode;
+		columnsReady = -1;
+	}
 
 	double Eval(const DblVec& input, DblVec& gradient);
+
+	//只保留cols这些列：复制出只含这些列的A
+	DifferentiableFunction* Restrict(const std::vector<size_t>& cols) const;
 };
@@ -0,0 +1,176 @@
+#include "lineSearch.h"
+#include "OWLQN.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+double LineSearch::Try(OptimizerState& state, double alpha, bool needGrad) {
+	return state.TryStep(alpha, needGrad);
+}
+
+void LineSearch::Accept(OptimizerState& state, double alpha, double value) {
+	state.TakeStep(alpha, value);
+}
+
+double LineSearch::InitialStep(const OptimizerState& state) {
+	if (state.histCount == 0) return 1 / sqrt(OptimizerState::dotProduct(state.dir, state.dir));
+	return 1.0;
+}
+
+double LineSearch::OrigDirDeriv(const OptimizerState& state) { return state.origDirDeriv; }
+double LineSearch::OrigValue(const OptimizerState& state) { return state.origValue; }
+double LineSearch::L1Weight(const OptimizerState& state) { return state.l1weight; }
+double LineSearch::NextDirDeriv(const OptimizerState& state) { return OptimizerState::dotProduct(state.newGrad, state.dir); }
+bool LineSearch::IsFirstIter(const OptimizerState& state) { return state.histCount == 0; }
+
+int BacktrackingLineSearch::Search(OptimizerState& state) {
+	double alpha = InitialStep(state);
+	double backoff = IsFirstIter(state) ? 0.1 : 0.5;
+	const double c1 = 1e-4;
+	double oldValue = OrigValue(state), origDirDeriv = OrigDirDeriv(state);
+
+	int evals = 0;
+	while (true) {
+		double value = Try(state, alpha, false);
+		evals++;
+		//计算的是线性查找更新步长的停止查找条件
+		if (value <= oldValue + c1 * origDirDeriv * alpha) {
+			Accept(state, alpha, value);
+			return evals;
+		}
+		//更新alpha：如果不符合停止查找条件，步长回退，即beta^n
+		alpha *= backoff;
+	}
+}
+
+int InterpolatingLineSearch::Search(OptimizerState& state) {
+	if (L1Weight(state) > 0) return ProjectedArmijo(state);
+	return StrongWolfe(state);
+}
+
+//过(a, fa)、(b, fb)且在两端导数为da、db的三次函数的极小点，不存在时返回区间中点
+static double cubicMin(double a, double fa, double da, double b, double fb, double db) {
+	double d1 = da + db - 3 * (fa - fb) / (a - b);
+	double disc = d1 * d1 - da * db;
+	if (disc < 0) return 0.5 * (a + b);
+	double d2 = (b > a ? 1 : -1) * sqrt(disc);
+	double denom = db - da + 2 * d2;
+	if (denom == 0) return 0.5 * (a + b);
+	return b - (b - a) * (db + d2 - d1) / denom;
+}
+
+int InterpolatingLineSearch::StrongWolfe(OptimizerState& state) {
+	double f0 = OrigValue(state), d0 = OrigDirDeriv(state);
+	double aPrev = 0, fPrev = f0, dPrev = d0;
+	double a = InitialStep(state);
+
+	int evals = 0;
+	while (true) {
+		double f = Try(state, a, true);
+		double d = NextDirDeriv(state);
+		evals++;
+		if (f > f0 + c1 * a * d0 || (evals > 1 && f >= fPrev)) {
+			return Zoom(state, aPrev, fPrev, dPrev, a, f, d, evals);
+		}
+		if (fabs(d) <= -c2 * d0) {
+			Accept(state, a, f);
+			return evals;
+		}
+		if (d >= 0) {
+			return Zoom(state, a, f, d, aPrev, fPrev, dPrev, evals);
+		}
+		if (evals >= maxEvals) {
+			//满足Armijo条件，只是曲率条件还不满足
+			Accept(state, a, f);
+			return evals;
+		}
+		//导数仍为负：放大步长
+		aPrev = a;
+		fPrev = f;
+		dPrev = d;
+		a *= 2;
+	}
+}
+
+//aLo处的函数值是目前满足Armijo条件的最小值，区间[aLo, aHi]中一定有满足强Wolfe条件的步长
+int InterpolatingLineSearch::Zoom(OptimizerState& state, double aLo, double fLo, double dLo, double aHi, double fHi, double dHi, int evals) {
+	double f0 = OrigValue(state), d0 = OrigDirDeriv(state);
+	while (true) {
+		if (evals >= maxEvals) {
+			if (aLo > 0) {
+				Accept(state, aLo, fLo);
+				return evals;
+			}
+			return evals + BacktrackingLineSearch().Search(state);
+		}
+
+		//三次插值，结果限制在区间内离两端至少10%的位置
+		double lo = min(aLo, aHi), width = fabs(aHi - aLo);
+		double a = cubicMin(aLo, fLo, dLo, aHi, fHi, dHi);
+		if (!(a >= lo + 0.1 * width && a <= lo + 0.9 * width)) {
+			a = max(lo + 0.1 * width, min(lo + 0.9 * width, a == a ? a : lo + 0.5 * width));
+		}
+
+		double f = Try(state, a, true);
+		double d = NextDirDeriv(state);
+		evals++;
+		if (f > f0 + c1 * a * d0 || f >= fLo) {
+			aHi = a;
+			fHi = f;
+			dHi = d;
+		} else {
+			if (fabs(d) <= -c2 * d0) {
+				Accept(state, a, f);
+				return evals;
+			}
+			if (d * (aHi - aLo) >= 0) {
+				aHi = aLo;
+				fHi = fLo;
+				dHi = dLo;
+			}
+			aLo = a;
+			fLo = f;
+			dLo = d;
+		}
+	}
+}
+
+//Nocedal & Wright 3.5节的插值回退：第一次回退用二次插值，之后用最近两个点的三次插值
+int InterpolatingLineSearch::ProjectedArmijo(OptimizerState& state) {
+	double f0 = OrigValue(state), d0 = OrigDirDeriv(state);
+	double a = InitialStep(state), aPrev = 0, fPrev = 0;
+
+	int evals = 0;
+	while (true) {
+		double f = Try(state, a, false);
+		evals++;
+		if (f <= f0 + c1 * a * d0) {
+			Accept(state, a, f);
+			return evals;
+		}
+
+		double next;
+		if (evals == 1) {
+			next = -d0 * a * a / (2 * (f - f0 - d0 * a));
+		} else {
+			double r1 = f - f0 - d0 * a, r2 = fPrev - f0 - d0 * aPrev;
+			double k = 1 / (a * a * aPrev * aPrev * (a - aPrev));
+			double A = k * (aPrev * aPrev * r1 - a * a * r2);
+			double B = k * (-aPrev * aPrev * aPrev * r1 + a * a * a * r2);
+			if (A == 0) {
+				next = -d0 / (2 * B);
+			} else {
+				next = (-B + sqrt(B * B - 3 * A * d0)) / (3 * A);
+			}
+		}
+		//象限边界处的投影使函数值不光滑，插值结果只作为参考，每次至少缩小一半
+		if (!(next >= 0.1 * a)) next = 0.1 * a;
+		if (!(next <= 0.5 * a)) next = 0.5 * a;
+
+		aPrev = a;
+		fPrev = f;
+		a = next;
+	}
+}
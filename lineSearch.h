@@ -0,0 +1,49 @@
+#pragma once
+
+class OptimizerState;
+
+//线性查找的策略：沿OptimizerState的搜索方向dir找步长alpha
+//尝试点都由GetNextPoint得到，所以跨象限的维度按OWL-QN的规则置零；判断条件中的方向导数是虚梯度与dir的内积
+struct LineSearch {
+	//结束时state的newX、newGrad、value为接受的点，返回计算目标函数的次数
+	virtual int Search(OptimizerState& state) = 0;
+	virtual ~LineSearch() { }
+
+protected:
+	//尝试步长alpha，返回newX处含l1的目标函数值；needGrad为true时newGrad一定是newX处的梯度
+	static double Try(OptimizerState& state, double alpha, bool needGrad);
+	//接受步长alpha，value为它的目标函数值；alpha不是最后一次尝试的步长时重新计算，最后一次尝试没有计算梯度时补算梯度
+	static void Accept(OptimizerState& state, double alpha, double value);
+	//初始步长：第一次迭代（没有记忆项，dir是最速下降方向）为1 / |dir|，之后为1；从热启动的记忆项开始时第一次迭代也为1
+	static double InitialStep(const OptimizerState& state);
+	//起点处沿dir的方向导数（虚梯度），当前的目标函数值，l1正则化项的系数
+	static double OrigDirDeriv(const OptimizerState& state);
+	static double OrigValue(const OptimizerState& state);
+	static double L1Weight(const OptimizerState& state);
+	//最后一次尝试的点处沿dir的方向导数newGrad·dir，只在l1weight为0且尝试时计算了梯度时有意义
+	static double NextDirDeriv(const OptimizerState& state);
+	static bool IsFirstIter(const OptimizerState& state);
+};
+
+//原来的回退线性查找：步长从1开始每次乘以0.5（第一次迭代从1 / |dir|开始，每次乘以0.1），直到满足Armijo条件
+struct BacktrackingLineSearch : public LineSearch {
+	int Search(OptimizerState& state);
+};
+
+//插值的线性查找
+//  l1weight为0时：强Wolfe条件，区间放大后用三次插值缩小区间（Nocedal & Wright, Algorithm 3.5/3.6），保证s·y > 0
+//  l1weight大于0时：目标函数在象限的边界上不可导，只用Armijo条件，回退的步长由二次/三次插值得到，并限制在上一步长的[0.1, 0.5]倍之间
+//    这时尝试点不需要梯度，可以使用LineSearchFunction的缓存
+struct InterpolatingLineSearch : public LineSearch {
+	const double c1, c2; //Armijo条件和曲率条件的系数
+	const int maxEvals; //强Wolfe查找最多计算的次数，超过时退回到回退线性查找
+
+	InterpolatingLineSearch(double c1 = 1e-4, double c2 = 0.9, int maxEvals = 20) : c1(c1), c2(c2), maxEvals(maxEvals) { }
+
+	int Search(OptimizerState& state);
+
+private:
+	int StrongWolfe(OptimizerState& state);
+	int Zoom(OptimizerState& state, double aLo, double fLo, double dLo, double aHi, double fHi, double dHi, int evals);
+	int ProjectedArmijo(OptimizerState& state);
+};
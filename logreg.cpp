@@ -1,190 +1,252 @@
 #include "logreg.h"
-#include <fstream>
-#include <sstream>
-#include <string>
+#include "parallel.h"
+#include "binaryData.h"
+#include "matrixMarket.h"
+#include "vecops.h"
 
-using namespace std;
+#include <algorithm>
+#include <cstring>
 
-void skipEmptyAndComment(ifstream& file, string& s) {
-	do {
-		getline(file, s);
-	} while (s.size() == 0 || s[0] == '%');
-}
+using namespace std;
 
 //
-LogisticRegressionProblem::LogisticRegressionProblem(const char* matFilename, const char* labelFilename) {
-	ifstream matfile(matFilename);
-	if (!matfile.good()) {
+LogisticRegressionProblem::LogisticRegressionProblem(const char* matFilename, const char* labelFilename, int numThreads) : labelView(NULL) {
+	if (IsBinaryDataFile(matFilename)) {
+		LoadBinary(matFilename);
+		return;
+	}
+
+	MatrixMarketHeader header;
+	if (!ReadMatrixMarketHeader(matFilename, header)) {
 		cerr << "error opening matrix file " << matFilename << endl;
 		exit(1);
 	}
-	string s;
-	getline(matfile, s);
-	//MatrixMarketһļʽ(http://math.nist.gov/MatrixMarket/formats.html)
-	//"%%MatrixMarket matrix coordinate real general"ָʽļĵһ
-	if (!s.compare("%%MatrixMarket matrix coordinate real general")) {
-		skipEmptyAndComment(matfile, s);
-
-		stringstream st(s);
-		size_t numIns, numNonZero;
-		st >> numIns >> numFeats >> numNonZero; //0ݸ
-
-		vector<deque<size_t> > rowInds(numIns);
-		vector<deque<float> > rowVals(numIns);
-		for (size_t i = 0; i < numNonZero; i++) {
-			size_t row, col;
-			float val;
-			matfile >> row >> col >> val; //кţкţֵ
-			row--;
-			col--;
-			rowInds[row].push_back(col);
-			rowVals[row].push_back(val);
-		}
 
-		matfile.close();
+	size_t numIns = header.rows; //
+	numFeats = header.cols;
+	instances = InstanceMatrix(numFeats);
 
-		ifstream labfile(labelFilename);
-		getline(labfile, s);
-		if (s.compare("%%MatrixMarket matrix array real general")) {
-			cerr << "unsupported label file format in " << labelFilename << endl;
-			exit(1);
-		}
-
-		skipEmptyAndComment(labfile, s);
-		stringstream labst(s);
-		size_t labNum, labCol;
-		labst >> labNum >> labCol;
-		if (labNum != numIns) {
-			cerr << "number of labels doesn't match number of instances in " << labelFilename << endl;
-			exit(1);
-		} else if (labCol != 1) {
-			cerr << "label matrix may not have more than one column" << endl;
-			exit(1);
+	//MatrixMarketһļʽ(http://math.nist.gov/MatrixMarket/formats.html)
+	//"%%MatrixMarket matrix coordinate real general"ָʽļĵһ
+	if (header.format == MatrixMarketHeader::Coordinate) {
+		//ϡֱӶCSRÿһ
+		vector<uint64_t> rowStarts;
+		vector<float> values;
+		if (instances.IndexBytes() == 4) {
+			vector<uint32_t> indices;
+			ReadMatrixMarketCoordinate(matFilename, header, numThreads, rowStarts, indices, values);
+			instances.AdoptSparse(numIns, rowStarts, indices, values);
+		} else {
+			vector<uint64_t> indices;
+			ReadMatrixMarketCoordinate(matFilename, header, numThreads, rowStarts, indices, values);
+			instances.AdoptSparse(numIns, rowStarts, indices, values);
 		}
-
-		instance_starts.push_back(0);
-
-		for (size_t i=0; i<numIns; i++) {
-			int label;
-			labfile >> label;
-			bool bLabel;
-			switch (label) {
-					case 1:
-						bLabel = true;
-						break;
-
-					case -1:
-						bLabel = false;
-						break;
-
-					default:
-						cerr << "illegal label: must be 1 or -1" << endl;
-						exit(1);
+	} else if (header.format == MatrixMarketHeader::Array) {
+		//ļад洢д洢ֿת
+		vector<float> colMajor, rowMajor(numIns * numFeats);
+		ReadMatrixMarketArray(matFilename, header, numThreads, colMajor);
+		const size_t tile = 64;
+		size_t nf = numFeats;
+		ParallelFor(numThreads, (numIns + tile - 1) / tile, [&](int, size_t begin, size_t end) {
+			for (size_t ib = begin * tile; ib < min(end * tile, numIns); ib += tile) {
+				for (size_t jb = 0; jb < nf; jb += tile) {
+					for (size_t j = jb; j < min(jb + tile, nf); j++) {
+						for (size_t i = ib; i < min(ib + tile, numIns); i++) {
+							rowMajor[i * nf + j] = colMajor[j * numIns + i];
+						}
+					}
+				}
 			}
+		});
+		instances.AdoptDense(numIns, rowMajor);
+	} else {
+		cerr << "unsupported matrix file format in " << matFilename << endl;
+		exit(1);
+	}
 
-			AddInstance(rowInds[i], rowVals[i], bLabel);//ilabel
-		}
-
-		labfile.close();
-	} else if (!s.compare("%%MatrixMarket matrix array real general")) {
-		skipEmptyAndComment(matfile, s);
-		stringstream st(s);
-		size_t numIns;
-		st >> numIns >> numFeats;
-
-		vector<vector<float> > rowVals(numIns);
+	ReadLabels(labelFilename, numIns, numThreads);
+}
 
-		for (size_t j=0; j<numFeats; j++) {
-			for (size_t i=0; i<numIns; i++) {
-				float val;
-				matfile >> val;
-				rowVals[i].push_back(val);
-			}
-		}
+LogisticRegressionProblem::LogisticRegressionProblem(const char* textFile, int hashBits, bool signedHash, int numThreads)
+	: instances((size_t)1 << hashBits), labelView(NULL), numFeats((size_t)1 << hashBits) {
+	vector<uint64_t> rowStarts;
+	vector<uint32_t> indices;
+	vector<float> values, labels;
+	ReadHashedText(textFile, hashBits, signedHash, numThreads, rowStarts, indices, values, labels);
+	size_t numIns = labels.size();
+	instances.AdoptSparse(numIns, rowStarts, indices, values);
+	labelBits.assign((numIns + 63) / 64, 0);
+	for (size_t i = 0; i < numIns; i++) {
+		if (labels[i] > 0) labelBits[i / 64] |= (uint64_t)1 << (i % 64);
+	}
+	labelView = labelBits.data();
+}
 
-		matfile.close();
+LogisticRegressionProblem::LogisticRegressionProblem(const LogisticRegressionProblem& other, size_t begin, size_t end)
+	: instances(other.instances.SelectRows(begin, end)), labelBits((end - begin + 63) / 64, 0), numFeats(other.numFeats) {
+	for (size_t i = begin; i < end; i++) {
+		if (other.LabelOf(i)) labelBits[(i - begin) / 64] |= (uint64_t)1 << ((i - begin) % 64);
+	}
+	labelView = labelBits.data();
+}
 
-		ifstream labfile(labelFilename);
-		getline(labfile, s);
-		if (s.compare("%%MatrixMarket matrix array real general")) { 
-			cerr << "unsupported label file format in " << labelFilename << endl;
-			exit(1);
-		}
+//labelļlabel1-1
+void LogisticRegressionProblem::ReadLabels(const char* labelFilename, size_t numIns, int numThreads) {
+	MatrixMarketHeader header;
+	if (!ReadMatrixMarketHeader(labelFilename, header) || header.format != MatrixMarketHeader::Array) {
+		cerr << "unsupported label file format in " << labelFilename << endl;
+		exit(1);
+	}
+	if (header.rows != numIns) {
+		cerr << "number of labels doesn't match number of instances in " << labelFilename << endl;
+		exit(1);
+	} else if (header.cols != 1) {
+		cerr << "label matrix may not have more than one column" << endl;
+		exit(1);
+	}
 
-		skipEmptyAndComment(labfile, s);
-		stringstream labst(s);
-		size_t labNum, labCol;
-		labst >> labNum >> labCol;
-		if (labNum != numIns) {
-			cerr << "number of labels doesn't match number of instances in " << labelFilename << endl;
-			exit(1);
-		} else if (labCol != 1) {
-			cerr << "label matrix may not have more than one column" << endl;
+	vector<float> labels;
+	ReadMatrixMarketArray(labelFilename, header, numThreads, labels);
+	labelBits.assign((numIns + 63) / 64, 0);
+	for (size_t i=0; i<numIns; i++) {
+		if (labels[i] == 1) {
+			labelBits[i / 64] |= (uint64_t)1 << (i % 64);
+		} else if (labels[i] != -1) {
+			cerr << "illegal label: must be 1 or -1" << endl;
 			exit(1);
 		}
+	}
+	labelView = labelBits.data();
+}
 
-		instance_starts.push_back(0);
-		for (size_t i=0; i<numIns; i++) {
-			int label;
-			labfile >> label;
-			bool bLabel;
-			switch (label) {
-					case 1:
-						bLabel = true;
-						break;
-
-					case -1:
-						bLabel = false;
-						break;
-
-					default:
-						cerr << "illegal label: must be 1 or -1" << endl;
-						exit(1);
-			}
-
-			AddInstance(rowVals[i], bLabel);
-		}
-
-		labfile.close();
-	} else {
-		cerr << "unsupported matrix file format in " << matFilename << endl;
+//ӳݼlabelֱʹӳڴ
+void LogisticRegressionProblem::LoadBinary(const char* filename) {
+	const BinaryDataHeader* h;
+	shared_ptr<MappedFile> file = MapBinaryData(filename, LogisticData, h);
+	numFeats = h->numCols;
+	instances = InstanceMatrix(numFeats);
+	if (h->numRows > 0 && instances.IndexBytes() != h->indexBytes && h->layout == InstanceMatrix::Sparse) {
+		cerr << "unexpected index width in binary data file " << filename << endl;
 		exit(1);
 	}
+	const char* base = file->Data();
+	instances.Attach((InstanceMatrix::Layout)h->layout, h->numRows, h->numNonZeros,
+		(const uint64_t*)(base + h->rowStartsOffset), base + h->indicesOffset, (const float*)(base + h->valuesOffset), file);
+	labelView = (const uint64_t*)(base + h->labelsOffset);
+	labelBacking = file;
+}
+
+void LogisticRegressionProblem::WriteBinary(const char* filename) const {
+	BinaryDataHeader h;
+	memset(&h, 0, sizeof(h));
+	h.kind = LogisticData;
+	h.layout = instances.GetLayout() == InstanceMatrix::Dense ? InstanceMatrix::Dense : InstanceMatrix::Sparse;
+	h.indexBytes = (uint32_t)instances.IndexBytes();
+	h.numRows = instances.NumRows();
+	h.numCols = numFeats;
+	h.numNonZeros = instances.NumNonZeros();
+	static const uint64_t emptyStarts = 0;
+	const uint64_t* starts = (h.numRows > 0) ? instances.RowStartsData() : &emptyStarts;
+	WriteBinaryData(filename, h, starts, instances.IndicesData(), instances.ValuesData(), labelView);
+}
+
+void LogisticRegressionProblem::Attach(InstanceMatrix::Layout layout, size_t numRows, size_t numNonZeros, const uint64_t* rowStarts, const void* indices, const float* values, const uint64_t* labels) {
+	instances.Attach(layout, numRows, numNonZeros, rowStarts, indices, values, shared_ptr<const void>());
+	labelBits.clear();
+	labelView = labels;
+	labelBacking.reset();
 }
 
 //һ
-void LogisticRegressionProblem::AddInstance(const deque<size_t>& inds, const deque<float>& vals, bool label) {
-	for (size_t i=0; i<inds.size(); i++) {
-		indices.push_back(inds[i]);
-		values.push_back(vals[i]);
-	}//ǰinds.size()ά±꼰Ӧֵ
-	instance_starts.push_back(indices.size());//һݵĿʼλãindicesvaluesе±꣩
-	labels.push_back(label);//ǰlabel
+void LogisticRegressionProblem::AddInstance(const vector<size_t>& inds, const vector<float>& vals, bool label) {
+	instances.AddSparseRow(inds.data(), vals.data(), inds.size());//ǰinds.size()ά±꼰Ӧֵ
+	AddLabel(label);//ǰlabel
 }
 
 void LogisticRegressionProblem::AddInstance(const vector<float>& vals, bool label) {
-	for (size_t i=0; i<vals.size(); i++) {
-		values.push_back(vals[i]);
+	if (vals.size() != numFeats) {
+		cerr << "dense instance must have " << numFeats << " values" << endl;
+		exit(1);
 	}
-	instance_starts.push_back(values.size()); 
-	labels.push_back(label);
+	instances.AddDenseRow(vals.data());
+	AddLabel(label);
 }
 
 //yi*W*Xi + b)
 double LogisticRegressionProblem::ScoreOf(size_t i, const vector<double>& weights) const {
-	double score = 0;
-	for (size_t j=instance_starts[i]; j < instance_starts[i+1]; j++) {
-		double value = values[j];
-		size_t index = (indices.size() > 0) ? indices[j] : j - instance_starts[i];
-		score += weights[index] * value;
-	}//iĸάȵֵȨصĳ˻ĺͣscore
-	if (!labels[i]) score *= -1; //ilabel-1scoreȡilabel
+	double score = instances.Dot(i, &weights[0]);//iĸάȵֵȨصĳ˻ĺͣscore
+	if (!LabelOf(i)) score *= -1; //ilabel-1scoreȡilabel
 	return score;
 }
 
+//㣺һscoreVecLogLossһЩʧlog(1.0 + exp(-score))
+//1-ȷĸʣûаscoreСķ֧Ҳexplog
+static const size_t kLossBlock = 256;
+
+double LogisticRegressionObjective::AddInstanceLosses(const DblVec& input, size_t begin, size_t end, DblVec& gradient, const size_t* rows, double scale) const {
+	double loss = 0;
+	double scores[kLossBlock], mults[kLossBlock];
+	for (size_t b = begin; b < end; b += kLossBlock) {
+		size_t count = min(kLossBlock, end - b);
+		for (size_t k = 0; k < count; k++) {
+			scores[k] = problem.ScoreOf(rows ? rows[b + k] : b + k, input);
+		}
+		loss += VecLogLoss(scores, mults, count);//ۼʧ
+
+		//ʹʧķݶ
+		//ii1-ȷĸʡݶ
+		for (size_t k = 0; k < count; k++) {
+			problem.AddMultTo(rows ? rows[b + k] : b + k, scale * mults[k], gradient);
+		}
+	}
+	return loss;
+}
+
 //㵱ǰĲµʧݶ
 //inputǲ
 double LogisticRegressionObjective::Eval(const DblVec& input, DblVec& gradient) {
+	return EvalRows(input, gradient, NULL, problem.NumInstances(), 1.0);
+}
+
+double LogisticRegressionObjective::EvalBatch(const std::vector<size_t>& batch, const DblVec& input, DblVec& gradient) {
+	return EvalRows(input, gradient, batch.data(), batch.size(), (double)problem.NumInstances() / batch.size());
+}
+
+std::vector<DblVec*> LogisticRegressionObjective::ThreadBuffers(DblVec& gradient) {
+	threadGrads.resize(numThreads - 1);
+	std::vector<DblVec*> bufs(numThreads);
+	bufs[0] = &gradient;
+	for (int t = 1; t < numThreads; t++) {
+		bufs[t] = &threadGrads[t - 1];
+	}
+	return bufs;
+}
+
+bool LogisticRegressionObjective::UseColumns() {
+	if (columnsReady < 0) {
+		columnsReady = UseColumnGradient(gradientMode, problem.Instances(), numThreads) ? 1 : 0;
+		if (columnsReady) {
+			columns.reset(new ColumnMatrix(problem.Instances()));
+			columnBounds = columns->Partition(numThreads);
+			//Ҫ̵߳ݶȻ
+			vector<DblVec>().swap(threadGrads);
+		} else {
+			columns.reset();
+		}
+	}
+	return columnsReady == 1;
+}
+
+void LogisticRegressionObjective::AddColumnGradient(double scale, DblVec& gradient) {
+	ParallelFor(numThreads, (size_t)numThreads, [&](int, size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			columns->AddTransposeMult(&rowMults[0], scale, &gradient[0], columnBounds[t], columnBounds[t + 1]);
+		}
+	});
+}
+
+double LogisticRegressionObjective::EvalRows(const DblVec& input, DblVec& gradient, const size_t* rows, size_t count, double scale) {
+	marginsValid = false;
 	double loss = 1.0; //ΪʲôҪʼΪ1
 
 	//ʹʧݶ
@@ -194,28 +256,139 @@ double LogisticRegressionObjective::Eval(const DblVec& input, DblVec& gradient)
 		gradient[i] = l2weight * input[i];//C * wiǰݶ()
 	}
 
-	for (size_t i =0 ; i<problem.NumInstances(); i++) {
-		double score = problem.ScoreOf(i, input);
-
-		//insProbiȷൽyiĸ
-		double insLoss, insProb;
-		if (score < -30) {
-			insLoss = -score;//ʧȡ-score-scoreȽϴʱlog(1.0 + exp(-score))Լ-score
-			insProb = 0;//ǰģͷȷĸΪ0
-		} else if (score > 30) {//score30ʱ
-			insLoss = 0;//ʧΪ0scoreȽϴʱlog(1.0 + exp(-score))Լ0
-			insProb = 1;//ǰģͷȷĸΪ1
-		} else {//score-3030֮ʱʹùʽ
-			double temp = 1.0 + exp(-score);
-			insLoss = log(temp);
-			insProb = 1.0/temp;
+	std::vector<double> losses(numThreads, 0.0);
+	losses[0] = loss;
+
+	if (rows == NULL && UseColumns()) {
+		//м㣺߳ԼǶʧϵٸԸһݶ
+		rowMults.resize(count);
+		ParallelFor(numThreads, count, [&](int t, size_t begin, size_t end) {
+			double scores[kLossBlock];
+			for (size_t b = begin; b < end; b += kLossBlock) {
+				size_t n = min(kLossBlock, end - b);
+				for (size_t k = 0; k < n; k++) {
+					scores[k] = problem.ScoreOf(b + k, input);
+				}
+				losses[t] += scale * VecLogLoss(scores, &rowMults[b], n);
+				for (size_t k = 0; k < n; k++) {
+					if (problem.LabelOf(b + k)) rowMults[b + k] = -rowMults[b + k];
+				}
+			}
+		});
+		AddColumnGradient(scale, gradient);
+		return TreeSum(losses);
+	}
+
+	if (numThreads <= 1) {
+		return loss + scale * AddInstanceLosses(input, 0, count, gradient, rows, scale);
+	}
+
+	//ֶ̣߳߳Σÿ̰߳ݶۼӵԼĻ󰴹̶˳ԼԹ̶߳ɸ
+	std::vector<DblVec*> bufs = ThreadBuffers(gradient);
+
+	ParallelFor(numThreads, count, [&](int t, size_t begin, size_t end) {
+		if (t > 0) bufs[t]->assign(input.size(), 0.0);
+		losses[t] += scale * AddInstanceLosses(input, begin, end, *bufs[t], rows, scale);
+	});
+	TreeReduce(bufs, input.size(), numThreads);
+
+	return TreeSum(losses);
+}
+
+//Բҿʼÿzd = X_idirһνܵĲûʱzxѾAcceptStepи£zdһ
+void LogisticRegressionObjective::BeginLineSearch(const DblVec& x, const DblVec& dir) {
+	lsX = &x;
+	lsDir = &dir;
+	size_t n = problem.NumInstances();
+	bool needX = !marginsValid;
+	zx.resize(n);
+	zd.resize(n);
+	ParallelFor(numThreads, n, [&](int, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			if (needX) problem.ScoresOf(i, &x[0], &dir[0], zx[i], zd[i]);
+			else zd[i] = problem.ScoresOf(i, &dir[0]);
 		}
-		loss += insLoss;//ۼʧ
+	});
+	xx = VecDot(&x[0], &x[0], x.size());
+	xd = VecDot(&x[0], &dir[0], x.size());
+	dd = VecDot(&dir[0], &dir[0], x.size());
+}
 
-		//ʹʧķݶ
-		//ii1-ȷĸʡݶ
-		problem.AddMultTo(i, 1.0 - insProb, gradient);
+//x + alpha * dirʧiscoreΪlabel * (zx[i] + alpha * zd[i])l2alphaĶκ
+double LogisticRegressionObjective::EvalAtStep(double alpha) {
+	std::vector<double> losses(numThreads, 0.0);
+	losses[0] = 1.0 + 0.5 * l2weight * (xx + alpha * (2 * xd + alpha * dd));
+	ParallelFor(numThreads, problem.NumInstances(), [&](int t, size_t begin, size_t end) {
+		double scores[kLossBlock];
+		for (size_t b = begin; b < end; b += kLossBlock) {
+			size_t count = min(kLossBlock, end - b);
+			for (size_t k = 0; k < count; k++) {
+				double score = zx[b + k] + alpha * zd[b + k];
+				scores[k] = problem.LabelOf(b + k) ? score : -score;
+			}
+			losses[t] += VecLogLoss(scores, NULL, count);
+		}
+	});
+	return TreeSum(losses);
+}
+
+//ܲalphaûڻĸʣһۼݶȣzxΪµĵڻ
+double LogisticRegressionObjective::AcceptStep(double alpha, DblVec& gradient) {
+	const DblVec& x = *lsX;
+	const DblVec& dir = *lsDir;
+	for (size_t j=0; j<x.size(); j++) {
+		gradient[j] = l2weight * (x[j] + alpha * dir[j]);
 	}
 
-	return loss;
+	std::vector<double> losses(numThreads, 0.0);
+	losses[0] = 1.0 + 0.5 * l2weight * (xx + alpha * (2 * xd + alpha * dd));
+	if (UseColumns()) {
+		rowMults.resize(problem.NumInstances());
+		ParallelFor(numThreads, problem.NumInstances(), [&](int t, size_t begin, size_t end) {
+			double scores[kLossBlock];
+			for (size_t b = begin; b < end; b += kLossBlock) {
+				size_t count = min(kLossBlock, end - b);
+				for (size_t k = 0; k < count; k++) {
+					zx[b + k] += alpha * zd[b + k];
+					scores[k] = problem.LabelOf(b + k) ? zx[b + k] : -zx[b + k];
+				}
+				losses[t] += VecLogLoss(scores, &rowMults[b], count);
+				for (size_t k = 0; k < count; k++) {
+					if (problem.LabelOf(b + k)) rowMults[b + k] = -rowMults[b + k];
+				}
+			}
+		});
+		AddColumnGradient(1.0, gradient);
+		marginsValid = true;
+		return TreeSum(losses);
+	}
+
+	std::vector<DblVec*> bufs = ThreadBuffers(gradient);
+	ParallelFor(numThreads, problem.NumInstances(), [&](int t, size_t begin, size_t end) {
+		if (t > 0) bufs[t]->assign(x.size(), 0.0);
+		double scores[kLossBlock], mults[kLossBlock];
+		for (size_t b = begin; b < end; b += kLossBlock) {
+			size_t count = min(kLossBlock, end - b);
+			for (size_t k = 0; k < count; k++) {
+				zx[b + k] += alpha * zd[b + k];
+				scores[k] = problem.LabelOf(b + k) ? zx[b + k] : -zx[b + k];
+			}
+			losses[t] += VecLogLoss(scores, mults, count);
+			for (size_t k = 0; k < count; k++) {
+				problem.AddMultTo(b + k, mults[k], *bufs[t]);
+			}
+		}
+	});
+	if (numThreads > 1) TreeReduce(bufs, x.size(), numThreads);
+
+	marginsValid = true;
+	return TreeSum(losses);
+}
+
+DifferentiableFunction* LogisticRegressionObjective::Restrict(const vector<size_t>& cols) const {
+	LogisticRegressionProblem* sub = new LogisticRegressionProblem(problem, cols);
+	LogisticRegressionObjective* obj = new LogisticRegressionObjective(*sub, l2weight, numThreads);
+	obj->SetGradientMode(gradientMode);
+	obj->ownedProblem.reset(sub);
+	return obj;
 }
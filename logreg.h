@@ -1,47 +1,83 @@
 #pragma once
 
-#include <deque>
 #include <vector>
 #include <cmath>
 #include <iostream>
+#include <memory>
 
 #include "OWLQN.h"
+#include "instanceMatrix.h"
+#include "columnMatrix.h"
 
 //Ҫǰ(MatrixMarketʽ)
 class LogisticRegressionProblem {
-	std::deque<size_t> indices; //iάֵindeces[instance_starts[i]]indices[instance_starts[i-1] - 1]
-	std::deque<float> values;//iindicesάֵӦֵvalues[instance_starts[i]]values[instance_starts[i-1] - 1]
-	std::deque<size_t> instance_starts;//iindicesvaluesеʼλãinstance_starts[i]
-	std::deque<bool> labels;//ilabellabels[i]labelΪbool
+	InstanceMatrix instances;//ϡCSR洢д洢
+	std::vector<uint64_t> labelBits;//ilabelλ洢labelBits[i / 64]ĵi % 64λ1ʾlabelΪ1
+	const uint64_t* labelView;//ָlabelBitsָӳ䵽ڴĶݼеlabel
+	std::shared_ptr<const void> labelBacking;
 	size_t numFeats;//ά
 
-public:
-	LogisticRegressionProblem(size_t numFeats) : numFeats(numFeats) {
-		instance_starts.push_back(0);
+	void AddLabel(bool label) {
+		size_t i = instances.NumRows() - 1;
+		if (i % 64 == 0) labelBits.push_back(0);
+		labelBits[i / 64] |= (uint64_t)label << (i % 64);
+		labelView = labelBits.data();
 	}
 
-	LogisticRegressionProblem(const char* mat, const char* labels);
-	void AddInstance(const std::deque<size_t>& inds, const std::deque<float>& vals, bool label);
+	void LoadBinary(const char* filename);
+	void ReadLabels(const char* labelFilename, size_t numIns, int numThreads);
+
+public:
+	LogisticRegressionProblem(size_t numFeats) : instances(numFeats), labelView(NULL), numFeats(numFeats) { }
+	LogisticRegressionProblem(const LogisticRegressionProblem& other)
+		: instances(other.instances), labelBits(other.labelBits), labelView(other.labelBacking ? other.labelView : labelBits.data()), labelBacking(other.labelBacking), numFeats(other.numFeats) { }
+	//ֻothercolsЩ⣬labelotherͬ
+	LogisticRegressionProblem(const LogisticRegressionProblem& other, const std::vector<size_t>& cols)
+		: instances(other.instances.SelectColumns(cols)), labelBits(other.labelBits), labelView(other.labelBacking ? other.labelView : labelBits.data()), labelBacking(other.labelBacking), numFeats(cols.size()) { }
+
+	//ֻotherеbeginend - 1⣬ڵõ߳зд
+	LogisticRegressionProblem(const LogisticRegressionProblem& other, size_t begin, size_t end);
+
+	//matMatrixMarketʽļҲǶݼʱlabelsʹãlabelݼУ
+	//numThreadsΪMatrixMarketļ߳
+	LogisticRegressionProblem(const char* mat, const char* labels, int numThreads = 1);
+	//libsvmVWʽıݣhash2^hashBitsάReadHashedTextlabel0Ϊ
+	LogisticRegressionProblem(const char* textFile, int hashBits, bool signedHash, int numThreads = 1);
+	//дɶݼ
+	void WriteBinary(const char* filename) const;
+	//ʹⲿlabel飬ʽһݷƬɵ֤߱Ч
+	void Attach(InstanceMatrix::Layout layout, size_t numRows, size_t numNonZeros, const uint64_t* rowStarts, const void* indices, const float* values, const uint64_t* labels);
+	void AddInstance(const std::vector<size_t>& inds, const std::vector<float>& vals, bool label);
 	void AddInstance(const std::vector<float>& vals, bool label);
 	double ScoreOf(size_t i, const std::vector<double>& weights) const;
 
+	//iwڻlabel
+	double ScoresOf(size_t i, const double* w) const {
+		return instances.Dot(i, w);
+	}
+
+	//iw1w2ڻlabelһαi
+	void ScoresOf(size_t i, const double* w1, const double* w2, double& s1, double& s2) const {
+		instances.Dot2(i, w1, w2, s1, s2);
+	}
+
 	bool LabelOf(size_t i) const {
-		return labels[i];
+		return (labelView[i / 64] >> (i % 64)) & 1;
 	}
 
+	//ڹ찴д洢ĸ
+	const InstanceMatrix& Instances() const { return instances; }
+
 	//ii1-ȷĸʡݶʹʧķݶ
 	void AddMultTo(size_t i, double mult, std::vector<double>& vec) const {
-		if (labels[i]) mult *= -1; //Ըıǩֵ(-label[i])
+		if (LabelOf(i)) mult *= -1; //Ըıǩֵ(-label[i])
 		//iĸάindexøάȶڵֵ*multȥݶάindex
-		for (size_t j=instance_starts[i]; j < instance_starts[i+1]; j++) {
-			size_t index = (indices.size() > 0) ? indices[j] : j - instance_starts[i];
-			vec[index] += mult * values[j];//ֵvalues
-		}
+		instances.AddMultTo(i, mult, &vec[0]);
 	}
 
 	//
 	size_t NumInstances() const {
-		return labels.size();
+		return instances.NumRows();
 	}
 
 	//ά
@@ -50,15 +86,65 @@ public:
 	}
 };
 
-struct LogisticRegressionObjective : public DifferentiableFunction {
+struct LogisticRegressionObjective : public StochasticDifferentiableFunction, public LineSearchFunction, public RestrictableFunction {
 	//洢
 	const LogisticRegressionProblem& problem;
+	std::unique_ptr<const LogisticRegressionProblem> ownedProblem;//RestrictõĿ꺯Լ
 	const double l2weight;
+	const int numThreads;//ʧݶȵ߳
+	std::vector<DblVec> threadGrads;//1numThreads-1̸߳Եݶۼӻ壬0ֱ߳ۼӵgradient
+	GradientMode gradientMode;
+	int columnsReady;//-1ûо0мݶȣ1мݶȣcolumnsѾ죩
+	std::unique_ptr<ColumnMatrix> columns;//мݶʱд洢ĸ
+	std::vector<size_t> columnBounds;//̸߳УcolumnBounds[t]columnBounds[t+1] - 1
+	DblVec rowMults;//мݶʱݶȵϵѳ-label
+
+	//ԲҵĻ棺xdirÿzx = X_ixzd = X_idirlabelԼҪxxxdirdirdir
+	const DblVec* lsX;
+	const DblVec* lsDir;
+	DblVec zx, zd;
+	double xx, xd, dd;
+	bool marginsValid;//zxǷһνܵĵڻǵĻһԲֻҪzd
 
-	LogisticRegressionObjective(const LogisticRegressionProblem& p, double l2weight = 0) : problem(p), l2weight(l2weight) { }
+	LogisticRegressionObjective(const LogisticRegressionProblem& p, double l2weight = 0, int numThreads = 1)
+		: problem(p), l2weight(l2weight), numThreads(numThreads), gradientMode(AutoGradient), columnsReady(-1), lsX(NULL), lsDir(NULL), xx(0), xd(0), dd(0), marginsValid(false) { }
+
+	//ȫݶȵĲм㷽ʽGradientModeֻòʱEvalBatch֤ǰм
+	void SetGradientMode(GradientMode mode) {
+		gradientMode = mode;
+		columnsReady = -1;
+	}
+
+	//Ƿмȫݶȣһξʹʱcolumns
+	bool UseColumns();
+	//мʱgradient += scale * X' * rowMults̸߳һ
+	void AddColumnGradient(double scale, DblVec& gradient);
+
+	//̵߳ݶȻ壺0gradientɸ߳Լ
+	std::vector<DblVec*> ThreadBuffers(DblVec& gradient);
+
+	//ۼ[begin, end)ʧǶݶȵĹ׳scaleӵgradient
+	//rowsΪNULLʱۼӵrows[begin]rows[end - 1]
+	double AddInstanceLosses(const DblVec& input, size_t begin, size_t end, DblVec& gradient, const size_t* rows = NULL, double scale = 1.0) const;
+
+	//countrowsΪNULLʱȫʧݶȣֳscale
+	double EvalRows(const DblVec& input, DblVec& gradient, const size_t* rows, size_t count, double scale);
 
 	//㵱ǰĲinputµʧݶ
 	//Żʧʧݶ
 	double Eval(const DblVec& input, DblVec& gradient);
 
+	//ֻbatchе㣬ֳNumInstances() / batch.size()
+	double EvalBatch(const std::vector<size_t>& batch, const DblVec& input, DblVec& gradient);
+
+	size_t NumInstances() const { return problem.NumInstances(); }
+
+	//ط㣺BeginLineSearchһαXdir֮ÿֻO()ļ
+	void BeginLineSearch(const DblVec& x, const DblVec& dir);
+	double EvalAtStep(double alpha);
+	double AcceptStep(double alpha, DblVec& gradient);
+
+	//ֻcolsЩƳֻЩе
+	DifferentiableFunction* Restrict(const std::vector<size_t>& cols) const;
+
 };
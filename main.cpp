@@ -1,10 +1,22 @@
 #include <iostream>
 #include <deque>
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
+#include <memory>
 
 #include "OWLQN.h"
 #include "leastSquares.h"
 #include "logreg.h"
+#include "streamingLogreg.h"
+#include "screening.h"
+#include "regPath.h"
+#include "crossValidation.h"
+#include "distributed.h"
+#include "numaLogreg.h"
+#include "telemetry.h"
 
 using namespace std;
 
@@ -14,7 +26,10 @@ void printUsageAndExit() {
 	cout << "usage: feature_file label_file regWeight output_file [options]" << endl;
 	cout << "  feature_file   input feature matrix in Matrix Market format (mxn real coordinate or array)" << endl;
 	cout << "                   rows represent features for each instance" << endl;
+	cout << "                   coordinate input is kept sparse for both formulations" << endl;
+	cout << "                   or a binary data file written by mm2bin (label_file is then ignored)" << endl;
 	cout << "  label_file     input instance labels in Matrix Market format (mx1 real array)" << endl;
+	cout << "                   ignored for binary data files and -hash text input" << endl;
 	cout << "                   rows contain single real value" << endl;
 	cout << "                   for logistic regression problems, value must be 1 or -1" << endl;
 	cout << "  regWeight      coefficient of l1 regularizer" << endl;
@@ -26,6 +41,60 @@ void printUsageAndExit() {
 	cout << "  -m <value>     sets L-BFGS memory parameter (default is 10)" << endl;
 	cout << "  -l2weight <value>" << endl;
 	cout << "                 sets L2 regularization weight (default is 0)" << endl;
+	cout << "  -floathistory  store the L-BFGS history in single precision (dot products still accumulate in double)" << endl;
+	cout << "  -activeset     restrict direction and line search work to coordinates that are nonzero or have a" << endl;
+	cout << "                 nonzero pseudo-gradient (uses the L-BFGS history projected onto them)" << endl;
+	cout << "  -screen        discard features with the strong rule before optimizing, then re-check optimality" << endl;
+	cout << "                 (KKT conditions) on all features and add back any violators (in-memory data only)" << endl;
+	cout << "  -path <count>  compute a regularization path of count l1 weights, log-spaced from the smallest weight" << endl;
+	cout << "                 with an all-zero model down to regWeight, each warm-started from the previous one;" << endl;
+	cout << "                 output_file then holds a (count)xm matrix with one weight vector per row" << endl;
+	cout << "  -cv <folds>    k-fold cross-validation of logistic regression over the grid given by -grid; output_file" << endl;
+	cout << "                 then receives one tab-separated line per configuration with the held-out log-loss and AUC" << endl;
+	cout << "  -grid <name>=<v1,v2,...>" << endl;
+	cout << "                 values tried by -cv for name (l1, l2, m or tol); may be repeated for several names," << endl;
+	cout << "                 unset names use regWeight, -l2weight, -m and -tol" << endl;
+	cout << "  -cvthreads <value>" << endl;
+	cout << "                 total threads for -cv (default is the number of cores); solves run concurrently," << endl;
+	cout << "                 each evaluating the objective on -threads threads" << endl;
+	cout << "  -membudget <MB>" << endl;
+	cout << "                 limit optimizer memory (working vectors and L-BFGS history) to MB megabytes;" << endl;
+	cout << "                 m is reduced before the run starts if the history would not fit" << endl;
+	cout << "  -compact       use the compact (Gram matrix) form of the L-BFGS two-loop recursion" << endl;
+	cout << "  -linesearch <backtrack|interp>" << endl;
+	cout << "                 line search strategy (default is backtrack): interp uses a strong Wolfe search" << endl;
+	cout << "                 with cubic interpolation when there is no l1 term, and interpolated backtracking" << endl;
+	cout << "                 on the projected OWL-QN path otherwise" << endl;
+	cout << "  -cachemargins  evaluate line search trials from cached X*x and X*dir (logistic regression only)" << endl;
+	cout << "  -threads <value>" << endl;
+	cout << "                 number of threads used to parse input and evaluate the objective (default is 1)" << endl;
+	cout << "  -gradient <auto|rows|columns>" << endl;
+	cout << "                 how -threads share the gradient of sparse in-memory data: rows gives each thread a" << endl;
+	cout << "                 private full-width gradient, columns keeps a column-major copy of the data and gives" << endl;
+	cout << "                 each thread a disjoint range of features; auto (default) picks columns when the" << endl;
+	cout << "                 private gradients would be larger than that copy" << endl;
+	cout << "  -numa          split the instances by NUMA node: each node's shard is copied by threads pinned to" << endl;
+	cout << "                 that node and only read by them, and gradients are reduced within each node before" << endl;
+	cout << "                 the nodes are combined (in-memory logistic regression with -threads)" << endl;
+	cout << "  -stochastic <value>" << endl;
+	cout << "                 mini-batch mode: start with batches of this many instances, growing each" << endl;
+	cout << "                 iteration until the full data set is used (logistic regression only)" << endl;
+	cout << "  -batchgrowth <value>" << endl;
+	cout << "                 growth factor of the mini-batch size per iteration (default is 1.5)" << endl;
+	cout << "  -stream <MB>   read a binary feature_file from disk in shards of at most MB megabytes on every" << endl;
+	cout << "                 evaluation instead of loading it into memory (logistic regression only)" << endl;
+	cout << "  -hash <bits>   feature_file is libsvm or VW text with labels on each line; feature names are hashed" << endl;
+	cout << "                 into 2^bits weights (1 to 31) while parsing" << endl;
+	cout << "  -signedhash    with -hash, also take the sign of each feature value from its hash" << endl;
+	cout << "  -dist <socket> <rank> <count>" << endl;
+	cout << "                 data-parallel training over count processes on this machine, which connect through the" << endl;
+	cout << "                 Unix socket path socket; each process passes its own shard of instances as" << endl;
+	cout << "                 feature_file/label_file and the same other options; rank 0 runs the optimizer and" << endl;
+	cout << "                 writes output_file, the others only evaluate their shard" << endl;
+	cout << "  -telemetry <file>" << endl;
+	cout << "                 write one JSON line per iteration to file: value, convergence criterion, step," << endl;
+	cout << "                 nonzeros, optimality residual, estimated optimizer bytes touched, and the time" << endl;
+	cout << "                 and call count of each phase (direction, two-loop, evaluations, line search, shift)" << endl;
 	cout << endl;
 	system("pause");
 	exit(0);
@@ -45,6 +114,20 @@ void printVector(const DblVec &vec, const char* filename) {
 	outfile.close();
 }
 
+//读入逗号分隔的非负数列表
+static bool parseList(const char* s, vector<double>& vals) {
+	vals.clear();
+	while (true) {
+		char* end;
+		double v = strtod(s, &end);
+		if (end == s || v < 0) return false;
+		vals.push_back(v);
+		if (*end == '\0') return true;
+		if (*end != ',') return false;
+		s = end + 1;
+	}
+}
+
 int main(int argc, char* argv[]) {
 
 	//输入测参数至少包括程序本身的名字、feature_file、label_file、regWeight（coefficient of l1 regularizer）、output_file五个参数
@@ -67,14 +150,34 @@ int main(int argc, char* argv[]) {
 	}
 
 	//给出默认值
-	bool leastSquares = false, quiet = false;
+	bool leastSquares = false, quiet = false, compact = false, cacheMargins = false, floatHistory = false, activeSet = false, screen = false;
 	double tol = 1e-4, l2weight = 0;
-	int m = 10;
+	int m = 10, numThreads = 1;
+	double streamMB = 0, batchGrowth = 1.5, memBudgetMB = 0;
+	int initialBatch = 0;
+	int pathCount = 0;
+	int cvFolds = 0, cvThreads = (int)thread::hardware_concurrency();
+	vector<double> gridL1, gridL2, gridM, gridTol;
+	bool interpolate = false;
+	const char* distSocket = NULL;
+	int distRank = 0, distSize = 1;
+	int hashBits = 0;
+	const char* telemetryFile = NULL;
+	GradientMode gradientMode = AutoGradient;
+	bool numa = false;
+	bool signedHash = false;
 
 	//对于可选的配置信息
 	for (int i=5; i<argc; i++) {
 		if (!strcmp(argv[i], "-ls")) leastSquares = true; //判断是否使用least square
 		else if (!strcmp(argv[i], "-q")) quiet = true; //判断是否静默输出
+		else if (!strcmp(argv[i], "-compact")) compact = true; //判断是否使用compact表示的L-BFGS
+		else if (!strcmp(argv[i], "-floathistory")) floatHistory = true; //判断是否按float存储记忆项
+		else if (!strcmp(argv[i], "-activeset")) activeSet = true; //判断是否只在活动维度上迭代
+		else if (!strcmp(argv[i], "-screen")) screen = true; //判断是否筛选特征
+		else if (!strcmp(argv[i], "-cachemargins")) cacheMargins = true; //线性查找中是否使用缓存的内积
+		else if (!strcmp(argv[i], "-signedhash")) signedHash = true; //判断是否使用带符号的特征hash
+		else if (!strcmp(argv[i], "-numa")) numa = true; //判断是否按NUMA节点划分样本
 		else if (!strcmp(argv[i], "-tol")) {
 			//读取tolerance
 			++i;
@@ -96,6 +199,120 @@ int main(int argc, char* argv[]) {
 				cout << "-m (L-BFGS memory param) flag requires 1 positive int argument." << endl;
 				exit(1);
 			}
+		} else if (!strcmp(argv[i], "-threads")) {
+			//读取计算损失和梯度的线程数
+			++i;
+			if (i >= argc || (numThreads = atoi(argv[i])) <= 0) {
+				cout << "-threads flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-linesearch")) {
+			//读取线性查找的方法
+			++i;
+			if (i < argc && !strcmp(argv[i], "backtrack")) interpolate = false;
+			else if (i < argc && !strcmp(argv[i], "interp")) interpolate = true;
+			else {
+				cout << "-linesearch flag requires 1 argument: backtrack or interp." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-gradient")) {
+			//读取多线程计算梯度的方式
+			++i;
+			if (i < argc && !strcmp(argv[i], "auto")) gradientMode = AutoGradient;
+			else if (i < argc && !strcmp(argv[i], "rows")) gradientMode = RowGradient;
+			else if (i < argc && !strcmp(argv[i], "columns")) gradientMode = ColumnGradient;
+			else {
+				cout << "-gradient flag requires 1 argument: auto, rows or columns." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-stochastic")) {
+			//读取随机模式的初始batch大小
+			++i;
+			if (i >= argc || (initialBatch = atoi(argv[i])) <= 0) {
+				cout << "-stochastic flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-batchgrowth")) {
+			//读取batch的增长倍数
+			++i;
+			if (i >= argc || (batchGrowth = atof(argv[i])) <= 1) {
+				cout << "-batchgrowth flag requires 1 real argument greater than 1." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-stream")) {
+			//读取流式读入时一个分片的大小
+			++i;
+			if (i >= argc || (streamMB = atof(argv[i])) <= 0) {
+				cout << "-stream flag requires 1 positive real argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-path")) {
+			//读取正则化路径上l1正则化项系数的个数
+			++i;
+			if (i >= argc || (pathCount = atoi(argv[i])) <= 0) {
+				cout << "-path flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-cv")) {
+			//读取交叉验证的fold数
+			++i;
+			if (i >= argc || (cvFolds = atoi(argv[i])) < 2) {
+				cout << "-cv flag requires 1 int argument of at least 2." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-cvthreads")) {
+			//读取交叉验证的总线程数
+			++i;
+			if (i >= argc || (cvThreads = atoi(argv[i])) <= 0) {
+				cout << "-cvthreads flag requires 1 positive int argument." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-grid")) {
+			//读取交叉验证中一个超参数的取值
+			++i;
+			const char* eq = (i < argc) ? strchr(argv[i], '=') : NULL;
+			vector<double>* grid = NULL;
+			if (eq != NULL) {
+				string name(argv[i], eq - argv[i]);
+				if (name == "l1") grid = &gridL1;
+				else if (name == "l2") grid = &gridL2;
+				else if (name == "m") grid = &gridM;
+				else if (name == "tol") grid = &gridTol;
+			}
+			if (grid == NULL || !parseList(eq + 1, *grid)) {
+				cout << "-grid flag requires 1 argument of the form l1|l2|m|tol=v1,v2,..." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-hash")) {
+			//读取特征hash的位数
+			++i;
+			if (i >= argc || (hashBits = atoi(argv[i])) < 1 || hashBits > 31) {
+				cout << "-hash flag requires 1 int argument between 1 and 31." << endl;
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "-dist")) {
+			//读取分布式训练的socket路径、本进程的编号和进程数
+			i += 3;
+			if (i >= argc || (distSize = atoi(argv[i])) <= 0 || (distRank = atoi(argv[i - 1])) < 0 || distRank >= distSize) {
+				cout << "-dist flag requires 3 arguments: socket path, rank and process count (0 <= rank < count)." << endl;
+				exit(1);
+			}
+			distSocket = argv[i - 2];
+		} else if (!strcmp(argv[i], "-telemetry")) {
+			//读取每次迭代的统计输出的文件
+			++i;
+			if (i >= argc) {
+				cout << "-telemetry flag requires 1 argument: the output file." << endl;
+				exit(1);
+			}
+			telemetryFile = argv[i];
+		} else if (!strcmp(argv[i], "-membudget")) {
+			//读取优化器内存的上限
+			++i;
+			if (i >= argc || (memBudgetMB = atof(argv[i])) <= 0) {
+				cout << "-membudget flag requires 1 positive real argument." << endl;
+				exit(1);
+			}
 		} else {
 			cerr << "unrecognized argument: " << argv[i] << endl;
 			exit(1);
@@ -112,24 +329,153 @@ int main(int argc, char* argv[]) {
 
 	DifferentiableFunction *obj;
 	size_t size;
-	if (leastSquares) {
-		LeastSquaresProblem *prob = new LeastSquaresProblem(feature_file, label_file);
-		obj = new LeastSquaresObjective(*prob, l2weight);
+	if (initialBatch > 0 && (leastSquares || streamMB > 0)) {
+		cout << "-stochastic is only supported for in-memory logistic regression." << endl;
+		exit(1);
+	}
+	if (cvFolds > 0 && (leastSquares || streamMB > 0 || initialBatch > 0 || pathCount > 0 || screen)) {
+		cout << "-cv is only supported for in-memory logistic regression without -stochastic, -path or -screen." << endl;
+		exit(1);
+	}
+	if (telemetryFile != NULL && cvFolds > 0) {
+		cout << "-telemetry cannot be combined with -cv." << endl;
+		exit(1);
+	}
+	if (distSocket != NULL && (cvFolds > 0 || initialBatch > 0 || screen)) {
+		cout << "-dist cannot be combined with -cv, -stochastic or -screen." << endl;
+		exit(1);
+	}
+	if (hashBits > 0 && streamMB > 0) {
+		cout << "-stream requires a binary data file; convert hashed text with mm2bin -hash first." << endl;
+		exit(1);
+	}
+	if (numa && (leastSquares || streamMB > 0 || cvFolds > 0 || initialBatch > 0 || screen)) {
+		cout << "-numa is only supported for in-memory logistic regression without -cv, -stochastic or -screen." << endl;
+		exit(1);
+	}
+	LogisticRegressionProblem *logProb = NULL;
+	//分布式训练时l2正则化项只由0号进程计算
+	if (distRank > 0) l2weight = 0;
+
+	if (streamMB > 0) {
+		if (leastSquares) {
+			cout << "-stream is only supported for logistic regression." << endl;
+			exit(1);
+		}
+		//不把数据读进内存，每次计算时从二进制数据集中分片读入
+		StreamingLogisticRegressionObjective *sobj = new StreamingLogisticRegressionObjective(feature_file, l2weight, numThreads, (uint64_t)(streamMB * (1 << 20)));
+		if (!quiet) cout << "streaming " << sobj->NumInstances() << " instances in " << sobj->NumShards() << " shards" << endl;
+		obj = sobj;
+		size = sobj->NumFeats();
+	} else if (leastSquares) {
+		LeastSquaresProblem *prob = hashBits > 0 ? new LeastSquaresProblem(feature_file, hashBits, signedHash, numThreads)
+			: new LeastSquaresProblem(feature_file, label_file, numThreads);
+		LeastSquaresObjective *lsObj = new LeastSquaresObjective(*prob, l2weight, numThreads);
+		lsObj->SetGradientMode(gradientMode);
+		obj = lsObj;
 		size = prob->NumFeats(); 
 	} else {
 		//将数据导入到逻辑回归问题中
-		LogisticRegressionProblem *prob = new LogisticRegressionProblem(feature_file, label_file);
-		obj = new LogisticRegressionObjective(*prob, l2weight);
-		size = prob->NumFeats(); 
+		logProb = hashBits > 0 ? new LogisticRegressionProblem(feature_file, hashBits, signedHash, numThreads)
+			: new LogisticRegressionProblem(feature_file, label_file, numThreads);
+		size = logProb->NumFeats(); 
+		if (numa) {
+			//各节点复制了自己的分片，原来的数据不再需要
+			NumaTopology topology = DetectNumaTopology();
+			NumaLogisticRegressionObjective *numaObj = new NumaLogisticRegressionObjective(*logProb, topology, l2weight, numThreads);
+			if (!quiet) cout << "placed instances on " << numaObj->NumNodes() << " of " << topology.NumNodes() << " NUMA nodes" << endl;
+			delete logProb;
+			logProb = NULL;
+			obj = numaObj;
+		} else {
+			LogisticRegressionObjective *logObj = new LogisticRegressionObjective(*logProb, l2weight, numThreads);
+			logObj->SetGradientMode(gradientMode);
+			obj = logObj;
+		}
 	}
 
 	//size为特征的维度，init为初始参数值向量，ans为结果参数值向量
 	DblVec init(size), ans(size);
 
+	unique_ptr<SocketCommunicator> comm;
+	DistributedObjective *distObj = NULL;
+	if (distSocket != NULL) {
+		comm.reset(new SocketCommunicator(distSocket, distRank, distSize));
+		if (distRank > 0) {
+			//其余进程只计算自己的那部分样本，直到0号进程结束训练
+			ServeDistributed(*obj, *comm, size, ans);
+			return 0;
+		}
+		if (!quiet) cout << "training on " << distSize << " processes" << endl;
+		distObj = new DistributedObjective(*obj, *comm, size);
+		obj = distObj;
+	}
+
+	//交叉验证中每次训练的OWLQN也用同样的设置
+	InterpolatingLineSearch interpSearch;
+	auto configure = [&](OWLQN& o) {
+		o.SetCompactHistory(compact);
+		o.SetFloatHistory(floatHistory);
+		o.SetActiveSet(activeSet);
+		o.SetMemoryBudget((size_t)(memBudgetMB * (1 << 20)));
+		if (interpolate) o.SetLineSearch(&interpSearch);
+	};
+
+	if (cvFolds > 0) {
+		//超参数网格：没有给出的超参数使用命令行中的值
+		if (gridL1.empty()) gridL1.push_back(regweight);
+		if (gridL2.empty()) gridL2.push_back(l2weight);
+		if (gridM.empty()) gridM.push_back(m);
+		if (gridTol.empty()) gridTol.push_back(tol);
+		vector<CVConfig> configs;
+		for (size_t a = 0; a < gridL1.size(); a++) for (size_t b = 0; b < gridL2.size(); b++)
+		for (size_t c = 0; c < gridM.size(); c++) for (size_t d = 0; d < gridTol.size(); d++) {
+			CVConfig config = { gridL1[a], gridL2[b], gridTol[d], (int)gridM[c] };
+			if (config.m <= 0 || config.tol <= 0) {
+				cout << "grid values of m and tol must be positive." << endl;
+				exit(1);
+			}
+			configs.push_back(config);
+		}
+
+		CrossValidation cv(*logProb, cvFolds);
+		vector<CVResult> results;
+		if (!quiet) cout << "cross-validating " << configs.size() << " configurations on " << cvFolds << " folds, "
+			<< max(1, cvThreads / numThreads) << " solves at a time" << endl;
+		cv.Run(configs, cvThreads, numThreads, configure, results);
+		if (!quiet) WriteCVResults(cout, results);
+		ofstream outfile(output_file);
+		if (!outfile.good()) {
+			cerr << "error opening output file " << output_file << endl;
+			exit(1);
+		}
+		WriteCVResults(outfile, results);
+		return 0;
+	}
+
 	OWLQN opt(quiet);
+	configure(opt);
+	unique_ptr<JsonLinesObserver> telemetry;
+	if (telemetryFile != NULL) {
+		telemetry.reset(new JsonLinesObserver(telemetryFile));
+		opt.SetObserver(telemetry.get());
+	}
+	opt.SetCachedLineSearch(cacheMargins);
+	if (initialBatch > 0) opt.SetStochastic(initialBatch, batchGrowth);
 	//输入依次是LogisticRegressionObjective（包含了样本数据、l2正则化项的系数、损失函数）、
 	//参数的初始化值、参数最终的结果、l1正则化项的系数、允许的误差、lbfgs的记忆的项数
-	opt.Minimize(*obj, init, ans, regweight, tol, m);
+	if (pathCount > 0) {
+		//正则化路径：数据只读入一次，依次优化多个l1正则化项系数
+		vector<PathPoint> path;
+		RegularizationPath(opt, *obj, size, regweight, pathCount, path, tol, m, screen, quiet);
+		if (distObj != NULL) distObj->Finish(path.back().weights);
+		WritePath(output_file, path);
+		return 0;
+	}
+
+	if (screen) MinimizeScreened(opt, *obj, init, ans, regweight, tol, m, quiet);
+	else opt.Minimize(*obj, init, ans, regweight, tol, m);
+	if (distObj != NULL) distObj->Finish(ans);
 
 	int nonZero = 0;
 	for (size_t i = 0; i<ans.size(); i++) {
@@ -0,0 +1,486 @@
+#include "matrixMarket.h"
+#include "parallel.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+#ifdef _WIN32
+#define mmSeek _fseeki64
+#else
+#define mmSeek fseeko
+#endif
+
+//每次从文件读入的字节数
+static const size_t kBlockBytes = 64 << 20;
+
+bool ReadMatrixMarketHeader(const char* filename, MatrixMarketHeader& header) {
+	ifstream file(filename, ios::binary);
+	if (!file.good()) return false;
+
+	getline(file, header.banner);
+	if (!header.banner.empty() && header.banner[header.banner.size() - 1] == '\r') header.banner.erase(header.banner.size() - 1);
+	if (!header.banner.compare("%%MatrixMarket matrix coordinate real general")) header.format = MatrixMarketHeader::Coordinate;
+	else if (!header.banner.compare("%%MatrixMarket matrix array real general")) header.format = MatrixMarketHeader::Array;
+	else {
+		header.format = MatrixMarketHeader::Unsupported;
+		return true;
+	}
+
+	//跳过空行和注释，下一行是矩阵的大小
+	string s;
+	do {
+		getline(file, s);
+	} while (file.good() && (s.size() == 0 || s[0] == '%' || s[0] == '\r'));
+
+	stringstream st(s);
+	header.rows = header.cols = header.nonZeros = 0;
+	st >> header.rows >> header.cols;
+	if (header.format == MatrixMarketHeader::Coordinate) st >> header.nonZeros;
+	else header.nonZeros = header.rows * header.cols;
+	header.dataOffset = file.good() ? (uint64_t)file.tellg() : 0;
+	return true;
+}
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline void skipBlanks(const char*& p, const char* end) {
+	while (p < end && isBlank(*p)) p++;
+}
+
+static inline void skipLine(const char*& p, const char* end) {
+	while (p < end && *p != '\n') p++;
+	if (p < end) p++;
+}
+
+static inline bool parseUnsigned(const char*& p, const char* end, uint64_t& out) {
+	skipBlanks(p, end);
+	const char* start = p;
+	uint64_t v = 0;
+	while (p < end && (unsigned)(*p - '0') < 10) {
+		v = v * 10 + (unsigned)(*p - '0');
+		p++;
+	}
+	out = v;
+	return p != start;
+}
+
+//解析一个浮点数：最多保留19位有效数字，再乘以或除以10的幂
+//不是正确舍入的：超过2^53的尾数转成double时舍入一次，乘除10^k（k <= 22时10^k是精确的double）再舍入一次，|k| > 22时pow()还有误差
+//所以结果可能与strtod相差1-2个ulp（double）；值最后存成float，对常见的输入舍入到float后与strtod的结果相同
+//nan、inf等少见的写法交给strtod
+static inline bool parseFloat(const char*& p, const char* end, double& out) {
+	static const double pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	skipBlanks(p, end);
+	const char* start = p;
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		p++;
+	}
+
+	uint64_t mant = 0;
+	int digits = 0, exp10 = 0;
+	bool any = false;
+	while (p < end && (unsigned)(*p - '0') < 10) {
+		if (digits < 19) {
+			mant = mant * 10 + (unsigned)(*p - '0');
+			if (mant) digits++;
+		} else {
+			exp10++;
+		}
+		any = true;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && (unsigned)(*p - '0') < 10) {
+			if (digits < 19) {
+				mant = mant * 10 + (unsigned)(*p - '0');
+				if (mant) digits++;
+				exp10--;
+			}
+			any = true;
+			p++;
+		}
+	}
+
+	if (!any) {
+		char token[64];
+		size_t len = 0;
+		p = start;
+		while (p < end && !isBlank(*p) && *p != '\n' && len + 1 < sizeof(token)) token[len++] = *p++;
+		token[len] = 0;
+		char* tokenEnd;
+		out = strtod(token, &tokenEnd);
+		return len > 0 && tokenEnd == token + len;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool expNeg = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			expNeg = (*p == '-');
+			p++;
+		}
+		uint64_t e;
+		if (!parseUnsigned(p, end, e)) return false;
+		if (e > 100000) e = 100000;
+		exp10 += expNeg ? -(int)e : (int)e;
+	}
+
+	double v = (double)mant;
+	if (exp10 >= 0 && exp10 <= 22) v *= pow10[exp10];
+	else if (exp10 < 0 && exp10 >= -22) v /= pow10[-exp10];
+	else v *= pow(10.0, exp10);
+	out = neg ? -v : v;
+	return true;
+}
+
+//按块读入文件的数据部分，每块在换行处切成numThreads段，parse(t, begin, end)解析第t段，整块解析完后调用finishBlock()
+//一块处理完之后才读下一块，最后一行不完整的内容留到下一块
+template <class Parse, class FinishBlock>
+static void parseBlocks(const char* filename, uint64_t offset, int numThreads, Parse parse, FinishBlock finishBlock) {
+	FILE* f = fopen(filename, "rb");
+	if (f == NULL || mmSeek(f, offset, SEEK_SET) != 0) {
+		cerr << "error opening matrix file " << filename << endl;
+		exit(1);
+	}
+
+	vector<char> buf(kBlockBytes);
+	size_t carry = 0;
+	while (true) {
+		if (carry == buf.size()) buf.resize(buf.size() * 2); //一行比一块还长
+		size_t got = fread(&buf[carry], 1, buf.size() - carry, f);
+		size_t len = carry + got;
+		bool eof = (got == 0);
+
+		//本块只处理到最后一个换行为止
+		size_t usable = len;
+		if (!eof) {
+			while (usable > 0 && buf[usable - 1] != '\n') usable--;
+		}
+
+		if (usable > 0) {
+			//在换行处切分给各个线程
+			vector<size_t> cuts(numThreads + 1, usable);
+			cuts[0] = 0;
+			for (int t = 1; t < numThreads; t++) {
+				size_t c = max(cuts[t - 1], usable / numThreads * t);
+				while (c < usable && c > 0 && buf[c - 1] != '\n') c++;
+				cuts[t] = c;
+			}
+			const char* base = buf.data();
+			ParallelFor(numThreads, (size_t)numThreads, [&](int, size_t begin, size_t end) {
+				for (size_t t = begin; t < end; t++) {
+					parse((int)t, base + cuts[t], base + cuts[t + 1]);
+				}
+			});
+			finishBlock();
+		}
+
+		if (eof) break;
+		carry = len - usable;
+		memmove(&buf[0], &buf[usable], carry);
+	}
+	fclose(f);
+}
+
+static void reportBadEntries(const vector<char>& bad, const char* filename) {
+	for (size_t t = 0; t < bad.size(); t++) {
+		if (bad[t]) {
+			cerr << "malformed entry in matrix file " << filename << endl;
+			exit(1);
+		}
+	}
+}
+
+namespace {
+
+struct Triple {
+	uint64_t row, col;
+	float val;
+};
+
+}
+
+template <class Index>
+void ReadMatrixMarketCoordinate(const char* filename, const MatrixMarketHeader& header, int numThreads,
+	vector<uint64_t>& rowStarts, vector<Index>& indices, vector<float>& values) {
+	if (numThreads < 1) numThreads = 1;
+
+	//按块、按线程的顺序保存解析出的三元组，依次连起来就是文件中的顺序
+	vector<vector<Triple> > chunks, current(numThreads);
+	vector<char> bad(numThreads, 0);
+	parseBlocks(filename, header.dataOffset, numThreads, [&](int t, const char* p, const char* end) {
+		vector<Triple>& out = current[t];
+		while (p < end) {
+			skipBlanks(p, end);
+			if (p == end) break;
+			if (*p == '\n' || *p == '%') {
+				skipLine(p, end);
+				continue;
+			}
+			Triple tr;
+			uint64_t row, col;
+			double val;
+			if (!parseUnsigned(p, end, row) || !parseUnsigned(p, end, col) || !parseFloat(p, end, val)
+				|| row == 0 || row > header.rows || col == 0 || col > header.cols) {
+				bad[t] = 1;
+				return;
+			}
+			tr.row = row - 1; //行号，列号从1开始
+			tr.col = col - 1;
+			tr.val = (float)val;
+			out.push_back(tr);
+			skipLine(p, end);
+		}
+	}, [&]() {
+		for (int t = 0; t < numThreads; t++) {
+			if (!current[t].empty()) {
+				chunks.push_back(vector<Triple>());
+				chunks.back().swap(current[t]);
+			}
+		}
+	});
+	reportBadEntries(bad, filename);
+
+	size_t total = 0;
+	for (size_t c = 0; c < chunks.size(); c++) total += chunks[c].size();
+	if (total != header.nonZeros) {
+		cerr << "matrix file " << filename << " has " << total << " entries but the header says " << header.nonZeros << endl;
+		exit(1);
+	}
+
+	//计数排序：先数出每行的元素个数得到行偏移，再按文件中的顺序把元素放到各行的位置
+	rowStarts.assign(header.rows + 1, 0);
+	for (size_t c = 0; c < chunks.size(); c++) {
+		for (size_t k = 0; k < chunks[c].size(); k++) rowStarts[chunks[c][k].row + 1]++;
+	}
+	for (size_t i = 0; i < header.rows; i++) rowStarts[i + 1] += rowStarts[i];
+
+	indices.resize(total);
+	values.resize(total);
+	vector<uint64_t> next(rowStarts.begin(), rowStarts.end() - 1);
+	for (size_t c = 0; c < chunks.size(); c++) {
+		for (size_t k = 0; k < chunks[c].size(); k++) {
+			const Triple& tr = chunks[c][k];
+			uint64_t pos = next[tr.row]++;
+			indices[pos] = (Index)tr.col;
+			values[pos] = tr.val;
+		}
+		vector<Triple>().swap(chunks[c]);
+	}
+}
+
+template void ReadMatrixMarketCoordinate<uint32_t>(const char*, const MatrixMarketHeader&, int, vector<uint64_t>&, vector<uint32_t>&, vector<float>&);
+template void ReadMatrixMarketCoordinate<uint64_t>(const char*, const MatrixMarketHeader&, int, vector<uint64_t>&, vector<uint64_t>&, vector<float>&);
+
+void ReadMatrixMarketArray(const char* filename, const MatrixMarketHeader& header, int numThreads, vector<float>& values) {
+	if (numThreads < 1) numThreads = 1;
+
+	vector<vector<float> > current(numThreads);
+	vector<char> bad(numThreads, 0);
+	values.clear();
+	values.reserve(header.nonZeros);
+	parseBlocks(filename, header.dataOffset, numThreads, [&](int t, const char* p, const char* end) {
+		vector<float>& out = current[t];
+		while (p < end) {
+			skipBlanks(p, end);
+			if (p == end) break;
+			if (*p == '\n' || *p == '%') {
+				skipLine(p, end);
+				continue;
+			}
+			double val;
+			if (!parseFloat(p, end, val)) {
+				bad[t] = 1;
+				return;
+			}
+			out.push_back((float)val);
+			skipLine(p, end);
+		}
+	}, [&]() {
+		for (int t = 0; t < numThreads; t++) {
+			values.insert(values.end(), current[t].begin(), current[t].end());
+			current[t].clear();
+		}
+	});
+	reportBadEntries(bad, filename);
+
+	if (values.size() != header.nonZeros) {
+		cerr << "matrix file " << filename << " has " << values.size() << " entries but the header says " << header.nonZeros << endl;
+		exit(1);
+	}
+}
+
+//MurmurHash3的x86_32版本，与VW使用的hash相同
+static uint32_t murmurHash3(const char* key, size_t len, uint32_t seed) {
+	const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+	uint32_t h = seed;
+	size_t nblocks = len / 4;
+	for (size_t i = 0; i < nblocks; i++) {
+		uint32_t k;
+		memcpy(&k, key + i * 4, 4);
+		k *= c1;
+		k = (k << 15) | (k >> 17);
+		k *= c2;
+		h ^= k;
+		h = (h << 13) | (h >> 19);
+		h = h * 5 + 0xe6546b64;
+	}
+	const unsigned char* tail = (const unsigned char*)key + nblocks * 4;
+	uint32_t k = 0;
+	switch (len & 3) {
+	case 3: k ^= (uint32_t)tail[2] << 16; // fallthrough
+	case 2: k ^= (uint32_t)tail[1] << 8; // fallthrough
+	case 1: k ^= tail[0];
+		k *= c1;
+		k = (k << 15) | (k >> 17);
+		k *= c2;
+		h ^= k;
+	}
+	h ^= (uint32_t)len;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+namespace {
+
+//一个线程解析出的若干行
+struct HashedRows {
+	vector<uint64_t> lengths;
+	vector<uint32_t> indices;
+	vector<float> values;
+	vector<float> labels;
+};
+
+}
+
+void ReadHashedText(const char* filename, int hashBits, bool signedHash, int numThreads,
+	vector<uint64_t>& rowStarts, vector<uint32_t>& indices, vector<float>& values, vector<float>& labels) {
+	if (numThreads < 1) numThreads = 1;
+	const uint32_t mask = (uint32_t)(((uint64_t)1 << hashBits) - 1);
+
+	vector<HashedRows> current(numThreads);
+	vector<char> bad(numThreads, 0);
+	rowStarts.assign(1, 0);
+	indices.clear();
+	values.clear();
+	labels.clear();
+	parseBlocks(filename, 0, numThreads, [&](int t, const char* p, const char* end) {
+		HashedRows& out = current[t];
+		//token为name[:value]，加入在seed下hash的特征
+		auto addFeature = [&](const char* token, const char* tokenEnd, uint32_t seed) -> bool {
+			const char* colon = tokenEnd;
+			while (colon > token && colon[-1] != ':') colon--;
+			double val = 1;
+			const char* nameEnd = tokenEnd;
+			if (colon > token) {
+				nameEnd = colon - 1;
+				const char* v = colon;
+				if (!parseFloat(v, tokenEnd, val) || v != tokenEnd) return false;
+			}
+			if (val == 0) return true;
+			uint32_t h = murmurHash3(token, nameEnd - token, seed);
+			if (signedHash && (h >> 31)) val = -val;
+			out.indices.push_back(h & mask);
+			out.values.push_back((float)val);
+			return true;
+		};
+
+		while (p < end) {
+			skipBlanks(p, end);
+			if (p == end) break;
+			if (*p == '\n' || *p == '#') {
+				skipLine(p, end);
+				continue;
+			}
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if (lineEnd == NULL) lineEnd = end;
+			double label;
+			if (!parseFloat(p, lineEnd, label)) {
+				bad[t] = 1;
+				return;
+			}
+			size_t before = out.indices.size();
+
+			const char* bar = (const char*)memchr(p, '|', lineEnd - p);
+			if (bar != NULL) {
+				//VW：跳过importance和tag，"|namespace"开始一个namespace，"| "是默认的namespace
+				p = bar;
+				uint32_t seed = 0;
+				while (p < lineEnd) {
+					if (*p == '|') {
+						const char* ns = ++p;
+						while (p < lineEnd && !isBlank(*p)) p++;
+						seed = (p == ns) ? 0 : murmurHash3(ns, p - ns, 0);
+						continue;
+					}
+					skipBlanks(p, lineEnd);
+					const char* token = p;
+					while (p < lineEnd && !isBlank(*p)) p++;
+					if (p > token && !addFeature(token, p, seed)) {
+						bad[t] = 1;
+						return;
+					}
+				}
+			} else {
+				//libsvm：qid不是特征
+				while (true) {
+					skipBlanks(p, lineEnd);
+					if (p == lineEnd || *p == '#') break;
+					const char* token = p;
+					while (p < lineEnd && !isBlank(*p)) p++;
+					if (p - token > 4 && !strncmp(token, "qid:", 4)) continue;
+					if (!addFeature(token, p, 0)) {
+						bad[t] = 1;
+						return;
+					}
+				}
+			}
+
+			out.lengths.push_back(out.indices.size() - before);
+			out.labels.push_back((float)label);
+			p = lineEnd;
+			skipLine(p, end);
+		}
+	}, [&]() {
+		//按线程的顺序接到CSR的末尾
+		for (int t = 0; t < numThreads; t++) {
+			HashedRows& rows = current[t];
+			for (size_t i = 0; i < rows.lengths.size(); i++) {
+				rowStarts.push_back(rowStarts.back() + rows.lengths[i]);
+			}
+			indices.insert(indices.end(), rows.indices.begin(), rows.indices.end());
+			values.insert(values.end(), rows.values.begin(), rows.values.end());
+			labels.insert(labels.end(), rows.labels.begin(), rows.labels.end());
+			rows.lengths.clear();
+			rows.indices.clear();
+			rows.values.clear();
+			rows.labels.clear();
+		}
+	});
+	for (size_t t = 0; t < bad.size(); t++) {
+		if (bad[t]) {
+			cerr << "malformed line in text data file " << filename << endl;
+			exit(1);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+//MatrixMarket文件的快速读入
+//文件按大块读入，每块在换行处切分给多个线程，每个线程用手写的整数和浮点数解析函数解析自己的那一段
+//coordinate格式不经过每行一个的临时容器，解析出的三元组按行号做一次计数排序直接得到CSR
+
+struct MatrixMarketHeader {
+	enum Format { Unsupported, Coordinate, Array };
+	Format format; //只支持real general的coordinate和array格式
+	std::string banner; //文件的第一行
+	size_t rows, cols, nonZeros; //array格式时nonZeros = rows * cols
+	uint64_t dataOffset; //数据部分在文件中的起始位置
+};
+
+//读入文件头；文件打不开时返回false
+bool ReadMatrixMarketHeader(const char* filename, MatrixMarketHeader& header);
+
+//读入coordinate格式的数据部分，按行构造CSR：第i行在indices和values中的位置为rowStarts[i]到rowStarts[i+1] - 1
+//同一行内的元素保持文件中的顺序；Index为uint32_t或uint64_t
+template <class Index>
+void ReadMatrixMarketCoordinate(const char* filename, const MatrixMarketHeader& header, int numThreads,
+	std::vector<uint64_t>& rowStarts, std::vector<Index>& indices, std::vector<float>& values);
+
+//读入array格式的数据部分，values按文件中的顺序（按列）存储
+void ReadMatrixMarketArray(const char* filename, const MatrixMarketHeader& header, int numThreads, std::vector<float>& values);
+
+//libsvm或VW格式的文本数据，每行一个样本，特征名hash到2^hashBits维（1 <= hashBits <= 31），直接得到CSR
+//  libsvm：label name[:value] name[:value] ...，name也当作字符串hash，'#'之后是注释
+//  VW：label [importance] [tag]|namespace name[:value] ... |namespace ...，importance和tag不使用，特征名在各自的namespace中hash
+//value缺省为1；signedHash为true时hash值的最高位决定特征值的符号，使冲突的特征在内积中的期望为0
+//hash冲突后同一行中可能有重复的下标，计算内积和梯度时效果与合并后相同；labels为每行的label
+void ReadHashedText(const char* filename, int hashBits, bool signedHash, int numThreads,
+	std::vector<uint64_t>& rowStarts, std::vector<uint32_t>& indices, std::vector<float>& values, std::vector<float>& labels);
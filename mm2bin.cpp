@@ -0,0 +1,67 @@
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+
+#include "leastSquares.h"
+#include "logreg.h"
+
+using namespace std;
+
+//把MatrixMarket格式的特征文件和label文件转成训练程序可以直接映射使用的二进制数据集
+void printUsageAndExit() {
+	cout << "Converts Matrix Market input to the binary data format read by the OWL-QN trainer" << endl << endl;
+	cout << "usage: feature_file label_file output_file [options]" << endl;
+	cout << "  feature_file   input feature matrix in Matrix Market format (mxn real coordinate or array)" << endl;
+	cout << "  label_file     input instance labels in Matrix Market format (mx1 real array)" << endl;
+	cout << "  output_file    binary data file; pass it to the trainer as feature_file" << endl << endl;
+	cout << "options:" << endl;
+	cout << "  -ls            convert a least squares problem (logistic regression is default)" << endl;
+	cout << "  -hash <bits>   feature_file is libsvm or VW text with labels on each line (label_file is ignored);" << endl;
+	cout << "                 feature names are hashed into 2^bits columns (1 to 31)" << endl;
+	cout << "  -signedhash    with -hash, also take the sign of each feature value from its hash" << endl;
+	cout << endl;
+	exit(0);
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 4 || !strcmp(argv[1], "-help") || !strcmp(argv[1], "--help") ||
+		!strcmp(argv[1], "-h") || !strcmp(argv[1], "-usage")) {
+			printUsageAndExit();
+	}
+
+	const char* feature_file = argv[1];
+	const char* label_file = argv[2];
+	const char* output_file = argv[3];
+
+	bool leastSquares = false, signedHash = false;
+	int hashBits = 0;
+	for (int i=4; i<argc; i++) {
+		if (!strcmp(argv[i], "-ls")) leastSquares = true;
+		else if (!strcmp(argv[i], "-signedhash")) signedHash = true;
+		else if (!strcmp(argv[i], "-hash")) {
+			++i;
+			if (i >= argc || (hashBits = atoi(argv[i])) < 1 || hashBits > 31) {
+				cout << "-hash flag requires 1 int argument between 1 and 31." << endl;
+				exit(1);
+			}
+		} else {
+			cerr << "unrecognized argument: " << argv[i] << endl;
+			exit(1);
+		}
+	}
+
+	if (leastSquares) {
+		unique_ptr<LeastSquaresProblem> prob(hashBits > 0 ? new LeastSquaresProblem(feature_file, hashBits, signedHash)
+			: new LeastSquaresProblem(feature_file, label_file));
+		prob->WriteBinary(output_file);
+		cout << "wrote " << prob->NumInstances() << " x " << prob->NumFeats() << " least squares problem to " << output_file << endl;
+	} else {
+		unique_ptr<LogisticRegressionProblem> prob(hashBits > 0 ? new LogisticRegressionProblem(feature_file, hashBits, signedHash)
+			: new LogisticRegressionProblem(feature_file, label_file));
+		prob->WriteBinary(output_file);
+		cout << "wrote " << prob->NumInstances() << " x " << prob->NumFeats() << " logistic regression problem to " << output_file << endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+#include "numa.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+#ifdef __linux__
+
+//解析"0-3,8-11"这样的CPU列表
+static vector<int> parseCpuList(const string& s) {
+	vector<int> cpus;
+	stringstream st(s);
+	string part;
+	while (getline(st, part, ',')) {
+		int lo, hi;
+		char dash;
+		stringstream ps(part);
+		if (!(ps >> lo)) continue;
+		if (ps >> dash >> hi) {
+			for (int c = lo; c <= hi; c++) cpus.push_back(c);
+		} else {
+			cpus.push_back(lo);
+		}
+	}
+	return cpus;
+}
+
+NumaTopology DetectNumaTopology() {
+	NumaTopology topo;
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return topo;
+
+	string online;
+	ifstream onlineFile("/sys/devices/system/node/online");
+	vector<int> nodes;
+	if (getline(onlineFile, online)) nodes = parseCpuList(online);
+	for (size_t n = 0; n < nodes.size(); n++) {
+		ostringstream path;
+		path << "/sys/devices/system/node/node" << nodes[n] << "/cpulist";
+		ifstream file(path.str().c_str());
+		string list;
+		if (!getline(file, list)) continue;
+		vector<int> cpus, all = parseCpuList(list);
+		for (size_t k = 0; k < all.size(); k++) {
+			if (all[k] < CPU_SETSIZE && CPU_ISSET(all[k], &allowed)) cpus.push_back(all[k]);
+		}
+		if (!cpus.empty()) topo.nodeCpus.push_back(cpus);
+	}
+
+	if (topo.nodeCpus.empty()) {
+		vector<int> cpus;
+		for (int c = 0; c < CPU_SETSIZE; c++) {
+			if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+		}
+		topo.nodeCpus.push_back(cpus);
+	}
+	return topo;
+}
+
+bool PinCurrentThread(const vector<int>& cpus) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t k = 0; k < cpus.size(); k++) {
+		if (cpus[k] < CPU_SETSIZE) CPU_SET(cpus[k], &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+vector<int> CurrentThreadCpus() {
+	vector<int> cpus;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+	for (int c = 0; c < CPU_SETSIZE; c++) {
+		if (CPU_ISSET(c, &set)) cpus.push_back(c);
+	}
+	return cpus;
+}
+
+#else
+
+NumaTopology DetectNumaTopology() {
+	NumaTopology topo;
+	topo.nodeCpus.push_back(vector<int>(1, 0));
+	return topo;
+}
+
+bool PinCurrentThread(const vector<int>&) {
+	return false;
+}
+
+vector<int> CurrentThreadCpus() {
+	return vector<int>();
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+//NUMA节点和各节点上的CPU
+//Linux上从/sys/devices/system/node读取，只保留本进程可以使用的CPU；读不到时（其他平台或没有NUMA信息）当作一个节点
+struct NumaTopology {
+	std::vector<std::vector<int> > nodeCpus; //没有可用CPU的节点不在其中
+
+	size_t NumNodes() const { return nodeCpus.size(); }
+};
+
+NumaTopology DetectNumaTopology();
+
+//把调用的线程限制在cpus上运行，之后这个线程新分配并第一次写入的内存页由内核放在这些CPU所在的节点上
+//不支持时或失败时返回false，线程照常运行
+bool PinCurrentThread(const std::vector<int>& cpus);
+
+//调用的线程当前可以运行的CPU，用于绑定之后恢复；不支持时或失败时为空
+std::vector<int> CurrentThreadCpus();
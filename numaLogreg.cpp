@@ -0,0 +1,86 @@
+#include "numaLogreg.h"
+#include "parallel.h"
+#include "vecops.h"
+
+using namespace std;
+
+//work中会绑定线程的ParallelFor：第0段在调用线程上执行，结束后恢复调用线程原来的CPU集合
+//否则调用线程一直留在第一个节点上，之后它创建的线程（包括其他目标函数的ParallelFor）都继承这个绑定
+template <class Work>
+static void pinnedParallelFor(int numThreads, size_t count, Work work) {
+	vector<int> callerCpus = CurrentThreadCpus();
+	ParallelFor(numThreads, count, work);
+	if (!callerCpus.empty()) PinCurrentThread(callerCpus);
+}
+
+NumaLogisticRegressionObjective::NumaLogisticRegressionObjective(const LogisticRegressionProblem& problem, const NumaTopology& topology, double l2weight, int numThreads)
+	: l2weight(l2weight), numThreads(numThreads), numFeats(problem.NumFeats()), threadGrads(numThreads) {
+	int numNodes = (int)min(topology.NumNodes(), (size_t)numThreads);
+	nodes.resize(numNodes);
+	threadNode.resize(numThreads);
+	for (int t = 0; t < numThreads; t++) {
+		threadNode[t] = (int)((size_t)t * numNodes / numThreads);
+	}
+	for (int n = 0, t = 0; n < numNodes; n++) {
+		nodes[n].cpus = topology.nodeCpus[n];
+		nodes[n].firstThread = t;
+		while (t < numThreads && threadNode[t] == n) t++;
+		nodes[n].numThreads = t - nodes[n].firstThread;
+	}
+
+	//各节点的分片：样本数与该节点的线程数成正比，由绑定在该节点上的线程复制
+	size_t numIns = problem.NumInstances();
+	pinnedParallelFor(numNodes, (size_t)numNodes, [&](int, size_t begin, size_t end) {
+		for (size_t n = begin; n < end; n++) {
+			NodeShard& node = nodes[n];
+			PinCurrentThread(node.cpus);
+			size_t first = numIns * node.firstThread / numThreads, last = numIns * (node.firstThread + node.numThreads) / numThreads;
+			node.problem.reset(new LogisticRegressionProblem(problem, first, last));
+			node.objective.reset(new LogisticRegressionObjective(*node.problem));
+		}
+	});
+}
+
+double NumaLogisticRegressionObjective::Eval(const DblVec& input, DblVec& gradient) {
+	vector<double> losses(numThreads, 0.0);
+	losses[0] = 1.0;
+	for (size_t i = 0; i < input.size(); i++) {
+		losses[0] += 0.5 * input[i] * input[i] * l2weight;
+		gradient[i] = l2weight * input[i];
+	}
+
+	//每个线程绑定到自己的节点，计算本节点分片中自己那一段样本
+	pinnedParallelFor(numThreads, (size_t)numThreads, [&](int, size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			const NodeShard& node = nodes[threadNode[t]];
+			PinCurrentThread(node.cpus);
+			size_t k = t - node.firstThread, rows = node.problem->NumInstances();
+			threadGrads[t].assign(numFeats, 0.0);
+			losses[t] += node.objective->AddInstanceLosses(input, rows * k / node.numThreads, rows * (k + 1) / node.numThreads, threadGrads[t]);
+		}
+	});
+
+	//节点内归约：本节点的各线程各负责一段维度，把其余线程的缓冲加到节点第一个线程的缓冲上
+	pinnedParallelFor(numThreads, (size_t)numThreads, [&](int, size_t begin, size_t end) {
+		for (size_t t = begin; t < end; t++) {
+			const NodeShard& node = nodes[threadNode[t]];
+			if (node.numThreads == 1) continue;
+			PinCurrentThread(node.cpus);
+			size_t k = t - node.firstThread;
+			size_t lo = numFeats * k / node.numThreads, hi = numFeats * (k + 1) / node.numThreads;
+			for (int u = node.firstThread + 1; u < node.firstThread + node.numThreads; u++) {
+				VecAdd(threadGrads[node.firstThread].data() + lo, threadGrads[u].data() + lo, hi - lo);
+			}
+		}
+	});
+
+	//跨节点合并：每个节点只读一份梯度；第t段由绑定在第t个线程所在节点上的线程计算，合并线程不会都挤在一个节点上
+	pinnedParallelFor(numThreads, numFeats, [&](int t, size_t lo, size_t hi) {
+		PinCurrentThread(nodes[threadNode[t]].cpus);
+		for (size_t n = 0; n < nodes.size(); n++) {
+			VecAdd(gradient.data() + lo, threadGrads[nodes[n].firstThread].data() + lo, hi - lo);
+		}
+	});
+
+	return TreeSum(losses);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "OWLQN.h"
+#include "logreg.h"
+#include "numa.h"
+
+//NUMA感知的逻辑回归目标函数
+//numThreads个线程按节点分成连续的组，样本按各节点的线程数切成连续的分片，每个节点一个分片
+//构造时每个分片由绑定在该节点上的线程复制一份（first touch），分片的内存就在该节点上；之后原来的问题可以释放
+//每次Eval各线程绑定在自己的节点上，只读本节点的分片，梯度累加到自己的缓冲（由这个线程清零，也在本节点上）
+//梯度先在节点内归约到该节点第一个线程的缓冲上，再把各节点的结果加到gradient上，跨节点只读每个节点的一份梯度
+//跨节点合并的线程与计算时一样分布在各节点上
+class NumaLogisticRegressionObjective : public DifferentiableFunction {
+	struct NodeShard {
+		std::vector<int> cpus;
+		int firstThread, numThreads; //属于这个节点的线程
+		std::unique_ptr<LogisticRegressionProblem> problem;
+		std::unique_ptr<LogisticRegressionObjective> objective; //只用它的AddInstanceLosses
+	};
+
+	std::vector<NodeShard> nodes;
+	std::vector<int> threadNode; //第t个线程所在的节点
+	const double l2weight;
+	const int numThreads;
+	const size_t numFeats;
+	std::vector<DblVec> threadGrads;
+
+	NumaLogisticRegressionObjective(const NumaLogisticRegressionObjective&);
+	NumaLogisticRegressionObjective& operator=(const NumaLogisticRegressionObjective&);
+
+public:
+	//线程数少于节点数时只使用前numThreads个节点；调用的线程作为第0个线程，计算时绑定在第一个节点上，返回前恢复原来的CPU集合
+	NumaLogisticRegressionObjective(const LogisticRegressionProblem& problem, const NumaTopology& topology, double l2weight = 0, int numThreads = 1);
+
+	size_t NumNodes() const { return nodes.size(); }
+	size_t NumFeats() const { return numFeats; }
+
+	double Eval(const DblVec& input, DblVec& gradient);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+//把[0, count)平均分成numThreads段，第t段交给work(t, begin, end)处理
+//第0段在调用线程上执行，其余各段各启动一个线程（段可能为空）；分段只取决于count和numThreads，所以结果可复现
+template <class Work>
+void ParallelFor(int numThreads, size_t count, Work work) {
+	if (numThreads <= 1) {
+		work(0, (size_t)0, count);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (int t = 1; t < numThreads; t++) {
+		size_t begin = count * t / numThreads, end = count * (t + 1) / numThreads;
+		threads.push_back(std::thread(work, t, begin, end));
+	}
+	work(0, (size_t)0, count / numThreads);
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
+
+//简单的线程池：numWorkers个线程依次领取任务0..numTasks-1，work(worker, task)处理一个任务
+//任务的耗时可以相差很大（例如不同参数下的训练），领取是动态的；第0个worker在调用线程上执行
+template <class Work>
+void ParallelTasks(int numWorkers, size_t numTasks, Work work) {
+	std::atomic<size_t> next(0);
+	auto run = [&](int worker) {
+		for (size_t task = next++; task < numTasks; task = next++) {
+			work(worker, task);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int w = 1; w < numWorkers && (size_t)w < numTasks; w++) {
+		threads.push_back(std::thread(run, w));
+	}
+	run(0);
+	for (size_t t = 0; t < threads.size(); t++) {
+		threads[t].join();
+	}
+}
+
+//把各线程的累加结果bufs[0..n)按固定的二叉树顺序加到bufs[0]上：
+//先bufs[0]+=bufs[1]、bufs[2]+=bufs[3]...，再bufs[0]+=bufs[2]...
+//每个维度的加法顺序只取决于n，所以对固定的线程数结果逐位相同；维度之间再分给numThreads个线程
+template <class Vec>
+void TreeReduce(std::vector<Vec*>& bufs, size_t dim, int numThreads) {
+	size_t n = bufs.size();
+	ParallelFor(numThreads, dim, [&](int, size_t begin, size_t end) {
+		for (size_t stride = 1; stride < n; stride *= 2) {
+			for (size_t t = 0; t + stride < n; t += 2 * stride) {
+				Vec& a = *bufs[t];
+				const Vec& b = *bufs[t + stride];
+				for (size_t i = begin; i < end; i++) {
+					a[i] += b[i];
+				}
+			}
+		}
+	});
+}
+
+//标量版本：按与TreeReduce相同的顺序求和
+inline double TreeSum(std::vector<double> vals) {
+	size_t n = vals.size();
+	if (n == 0) return 0;
+	for (size_t stride = 1; stride < n; stride *= 2) {
+		for (size_t t = 0; t + stride < n; t += 2 * stride) {
+			vals[t] += vals[t + stride];
+		}
+	}
+	return vals[0];
+}
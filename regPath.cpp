@@ -0,0 +1,70 @@
+#include "regPath.h"
+#include "screening.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+using namespace std;
+
+void RegularizationPath(const OWLQN& opt, DifferentiableFunction& function, size_t dim, double minWeight, int numWeights,
+	vector<PathPoint>& path, double tol, int m, bool screen, bool quiet) {
+	DblVec x(dim, 0.0), grad(dim);
+	function.Eval(x, grad);
+	double lambdaMax = 0;
+	for (size_t j = 0; j < dim; j++) {
+		lambdaMax = max(lambdaMax, fabs(grad[j]));
+	}
+	if (minWeight <= 0 || minWeight >= lambdaMax) {
+		cerr << "the smallest l1 weight of the path must be in (0, " << lambdaMax << "), where every larger weight gives an all-zero model" << endl;
+		exit(1);
+	}
+
+	LbfgsHistory history;
+	double prevWeight = lambdaMax;
+	path.clear();
+	for (int k = 0; k < numWeights; k++) {
+		double weight = (numWeights == 1) ? minWeight : lambdaMax * pow(minWeight / lambdaMax, (double)k / (numWeights - 1));
+		if (!quiet) cout << endl << "path point " << k + 1 << "/" << numWeights << ": l1 weight " << scientific << setprecision(4) << weight << endl;
+
+		PathPoint point;
+		point.l1weight = weight;
+		if (screen) MinimizeScreened(opt, function, x, point.weights, weight, tol, m, quiet, prevWeight);
+		else opt.Minimize(function, x, point.weights, weight, tol, m, &history);
+
+		point.nonZeros = 0;
+		for (size_t j = 0; j < dim; j++) {
+			if (point.weights[j] != 0) point.nonZeros++;
+		}
+		if (!quiet) cout << "path point " << k + 1 << ": " << point.nonZeros << "/" << dim << " non-zero weights" << endl;
+
+		x = point.weights;
+		prevWeight = weight;
+		path.push_back(point);
+	}
+}
+
+void WritePath(const char* filename, const vector<PathPoint>& path) {
+	ofstream outfile(filename);
+	if (!outfile.good()) {
+		cerr << "error opening matrix file " << filename << endl;
+		exit(1);
+	}
+	size_t dim = path.empty() ? 0 : path[0].weights.size();
+	outfile << "%%MatrixMarket matrix array real general" << endl;
+	outfile << "% regularization path: row k holds the weights for the k-th l1 weight" << endl;
+	outfile << "% k l1weight nonzeros" << endl;
+	for (size_t k = 0; k < path.size(); k++) {
+		outfile << "% " << k + 1 << " " << path[k].l1weight << " " << path[k].nonZeros << endl;
+	}
+	outfile << path.size() << " " << dim << endl;
+	//array格式按列存储
+	for (size_t j = 0; j < dim; j++) {
+		for (size_t k = 0; k < path.size(); k++) {
+			outfile << path[k].weights[j] << endl;
+		}
+	}
+	outfile.close();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <vector>
+
+#include "OWLQN.h"
+
+//正则化路径上的一个点：l1正则化项的系数、对应的最优参数和非零参数的个数
+struct PathPoint {
+	double l1weight;
+	DblVec weights;
+	size_t nonZeros;
+};
+
+//数据只读入一次，按从大到小的l1weight依次优化：
+//  第一个l1weight为lambdaMax = max|g_j(0)|（这时最优解为0），之后按对数等间隔减小到minWeight，共numWeights个
+//  每次从上一个l1weight的解和L-BFGS记忆项开始迭代（热启动）
+//screen为true时每次用sequential strong rule（上一个l1weight和上一个解处的梯度）筛选特征，这时不传递记忆项
+void RegularizationPath(const OWLQN& opt, DifferentiableFunction& function, size_t dim, double minWeight, int numWeights,
+	std::vector<PathPoint>& path, double tol = 1e-4, int m = 10, bool screen = false, bool quiet = false);
+
+//把路径写成MatrixMarket格式的numWeights * dim矩阵，第k行为第k个l1weight的参数；各个l1weight和非零参数个数写在注释行中
+void WritePath(const char* filename, const std::vector<PathPoint>& path);
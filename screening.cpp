@@ -0,0 +1,70 @@
+#include "screening.h"
+
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+void MinimizeScreened(const OWLQN& opt, DifferentiableFunction& function, const DblVec& initial, DblVec& minimum,
+	double l1weight, double tol, int m, bool quiet, double prevWeight) {
+	RestrictableFunction* restrictable = dynamic_cast<RestrictableFunction*>(&function);
+	if (restrictable == NULL) {
+		cerr << "feature screening requires a function that can be restricted to a subset of features" << endl;
+		exit(1);
+	}
+	if (l1weight <= 0) {
+		opt.Minimize(function, initial, minimum, l1weight, tol, m);
+		return;
+	}
+
+	size_t dim = initial.size();
+	DblVec grad(dim);
+	function.Eval(initial, grad);
+	double lambdaMax = 0;
+	for (size_t j = 0; j < dim; j++) {
+		lambdaMax = max(lambdaMax, fabs(grad[j]));
+	}
+
+	//strong rule：保留的特征kept[j]为1
+	double threshold = 2 * l1weight - (prevWeight > 0 ? prevWeight : lambdaMax);
+	vector<char> kept(dim, 0);
+	vector<size_t> cols;
+	for (size_t j = 0; j < dim; j++) {
+		if (initial[j] != 0 || fabs(grad[j]) >= threshold) {
+			kept[j] = 1;
+			cols.push_back(j);
+		}
+	}
+	if (!quiet) cout << "strong rule keeps " << cols.size() << " of " << dim << " features" << endl;
+
+	minimum = initial;
+	while (true) {
+		if (!cols.empty()) {
+			DblVec subInit(cols.size()), subMin(cols.size());
+			for (size_t k = 0; k < cols.size(); k++) subInit[k] = minimum[cols[k]];
+			unique_ptr<DifferentiableFunction> sub(restrictable->Restrict(cols));
+			opt.Minimize(*sub, subInit, subMin, l1weight, tol, m);
+			for (size_t k = 0; k < cols.size(); k++) minimum[cols[k]] = subMin[k];
+		}
+
+		//KKT条件：被丢弃的特征参数为0，需要|g_j| <= l1weight
+		function.Eval(minimum, grad);
+		size_t violations = 0;
+		for (size_t j = 0; j < dim; j++) {
+			if (!kept[j] && fabs(grad[j]) > l1weight) {
+				kept[j] = 1;
+				violations++;
+			}
+		}
+		if (!quiet) cout << "KKT check on all features: " << violations << " violations" << endl;
+		if (violations == 0) break;
+
+		cols.clear();
+		for (size_t j = 0; j < dim; j++) {
+			if (kept[j]) cols.push_back(j);
+		}
+		if (!quiet) cout << "re-optimizing with " << cols.size() << " features" << endl;
+	}
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "OWLQN.h"
+
+//用strong rule筛选特征后只在保留的特征上优化（Tibshirani et al. 2012）：
+//  在初始点计算一次完整的梯度g，lambdaMax = max|g_j|，初始参数为0且|g_j| < 2 * l1weight - lambdaMax的特征被丢弃，
+//  即把sequential strong rule从lambdaMax一步用到l1weight；保留的特征由RestrictableFunction::Restrict复制成更小的样本矩阵
+//strong rule可能丢弃最优解中非零的特征，所以优化结束后在全部数据上检查KKT条件：被丢弃的特征必须满足|g_j| <= l1weight
+//违反的特征加回去，从当前的解开始重新优化，直到没有违反的特征，所以结果与不筛选时的最优解满足同样的最优性条件
+//prevWeight不为0时用它代替lambdaMax，即正则化路径上从上一个l1weight（initial为它的解）到l1weight的sequential strong rule
+//function必须是RestrictableFunction；l1weight为0时不筛选，直接优化
+void MinimizeScreened(const OWLQN& opt, DifferentiableFunction& function, const DblVec& initial, DblVec& minimum,
+	double l1weight, double tol = 1e-4, int m = 10, bool quiet = false, double prevWeight = 0);
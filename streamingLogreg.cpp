@@ -0,0 +1,147 @@
+#include "streamingLogreg.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+StreamingLogisticRegressionObjective::StreamingLogisticRegressionObjective(const char* filename, double l2weight, int numThreads, uint64_t shardBytes)
+	: header(ReadBinaryDataHeader(filename, LogisticData)), reader(filename), nextBuffer(0), resident(false), l2weight(l2weight), numThreads(numThreads) {
+	if (header.layout == InstanceMatrix::Sparse && header.numRows > 0 && InstanceMatrix(header.numCols).IndexBytes() != header.indexBytes) {
+		cerr << "unexpected index width in binary data file " << filename << endl;
+		exit(1);
+	}
+	SplitShards(shardBytes);
+	for (int b = 0; b < 2; b++) {
+		buffers[b].reset(new ShardBuffer(header.numCols));
+	}
+}
+
+StreamingLogisticRegressionObjective::~StreamingLogisticRegressionObjective() {
+	WaitLoad();
+}
+
+//按64行一组扫描rowStarts，一个分片的数组超过shardBytes之前切开；rowStarts也分块读入
+void StreamingLogisticRegressionObjective::SplitShards(uint64_t shardBytes) {
+	bool sparse = (header.layout == InstanceMatrix::Sparse);
+	uint64_t bytesPerNonZero = sizeof(float) + (sparse ? header.indexBytes : 0);
+	const size_t chunkRows = 64 * 4096;
+	vector<uint64_t> starts;
+	Shard cur = { 0, 0, 0, 0 };
+	for (size_t chunk = 0; chunk < header.numRows; chunk += chunkRows) {
+		size_t rows = min(chunkRows, (size_t)header.numRows - chunk);
+		if (sparse) {
+			starts.resize(rows + 1);
+			reader.ReadAt(header.rowStartsOffset + chunk * sizeof(uint64_t), starts.data(), (rows + 1) * sizeof(uint64_t));
+		}
+		for (size_t g = 0; g < rows; g += 64) {
+			size_t groupRows = min((size_t)64, rows - g);
+			if (sparse && starts[g + groupRows] < starts[g]) {
+				cerr << "corrupt binary data file " << reader.Name() << endl;
+				exit(1);
+			}
+			uint64_t groupNonZeros = sparse ? starts[g + groupRows] - starts[g] : groupRows * header.numCols;
+			uint64_t newRows = cur.numRows + groupRows, newNonZeros = cur.numNonZeros + groupNonZeros;
+			uint64_t bytes = (sparse ? (newRows + 1) * sizeof(uint64_t) : 0) + newNonZeros * bytesPerNonZero + (newRows + 63) / 64 * sizeof(uint64_t);
+			if (cur.numRows > 0 && bytes > shardBytes) {
+				shards.push_back(cur);
+				cur.firstRow += cur.numRows;
+				cur.firstNonZero += cur.numNonZeros;
+				cur.numRows = 0;
+				cur.numNonZeros = 0;
+			}
+			cur.numRows += groupRows;
+			cur.numNonZeros += groupNonZeros;
+		}
+	}
+	if (cur.numRows > 0) shards.push_back(cur);
+}
+
+//把第s个分片读进buf，并让buf.problem指向读入的数组
+void StreamingLogisticRegressionObjective::LoadShard(size_t s, ShardBuffer& buf) {
+	const Shard& shard = shards[s];
+	bool sparse = (header.layout == InstanceMatrix::Sparse);
+	if (sparse) {
+		buf.rowStarts.resize(shard.numRows + 1);
+		reader.ReadAt(header.rowStartsOffset + shard.firstRow * sizeof(uint64_t), buf.rowStarts.data(), (shard.numRows + 1) * sizeof(uint64_t));
+		if (buf.rowStarts[0] != shard.firstNonZero || buf.rowStarts[shard.numRows] != shard.firstNonZero + shard.numNonZeros) {
+			cerr << "binary data file changed while training" << endl;
+			exit(1);
+		}
+		for (size_t i = 0; i <= shard.numRows; i++) {
+			buf.rowStarts[i] -= shard.firstNonZero;
+		}
+		uint64_t indexBytes = shard.numNonZeros * header.indexBytes;
+		buf.indices.resize((indexBytes + 7) / 8);
+		reader.ReadAt(header.indicesOffset + shard.firstNonZero * header.indexBytes, buf.indices.data(), indexBytes);
+		//文件不整个映射，每个分片读入后检查，损坏的文件不会在计算中越界读写
+		if (!CheckSparseArrays(buf.rowStarts.data(), shard.numRows, buf.indices.data(), header.indexBytes, shard.numNonZeros, header.numCols)) {
+			cerr << "corrupt binary data file " << reader.Name() << endl;
+			exit(1);
+		}
+	}
+	buf.values.resize(shard.numNonZeros);
+	reader.ReadAt(header.valuesOffset + shard.firstNonZero * sizeof(float), buf.values.data(), shard.numNonZeros * sizeof(float));
+	buf.labels.resize((shard.numRows + 63) / 64);
+	reader.ReadAt(header.labelsOffset + shard.firstRow / 64 * sizeof(uint64_t), buf.labels.data(), buf.labels.size() * sizeof(uint64_t));
+
+	buf.problem.Attach((InstanceMatrix::Layout)header.layout, shard.numRows, shard.numNonZeros,
+		sparse ? buf.rowStarts.data() : NULL, sparse ? buf.indices.data() : NULL, buf.values.data(), buf.labels.data());
+}
+
+void StreamingLogisticRegressionObjective::StartLoad(size_t s, int b) {
+	loader = thread([this, s, b]() { LoadShard(s, *buffers[b]); });
+}
+
+void StreamingLogisticRegressionObjective::WaitLoad() {
+	if (loader.joinable()) loader.join();
+}
+
+double StreamingLogisticRegressionObjective::Eval(const DblVec& input, DblVec& gradient) {
+	double loss = 1.0;
+	for (size_t i=0; i<input.size(); i++) {
+		loss += 0.5 * input[i] * input[i] * l2weight;
+		gradient[i] = l2weight * input[i];
+	}
+
+	//与LogisticRegressionObjective相同：第0个线程直接累加到gradient上，其余线程用自己的缓冲
+	threadGrads.resize(numThreads - 1);
+	std::vector<DblVec*> bufs(numThreads);
+	bufs[0] = &gradient;
+	for (int t = 1; t < numThreads; t++) {
+		threadGrads[t - 1].assign(input.size(), 0.0);
+		bufs[t] = &threadGrads[t - 1];
+	}
+	std::vector<double> losses(numThreads, 0.0);
+	losses[0] = loss;
+
+	auto addShard = [&](const ShardBuffer& buf) {
+		ParallelFor(numThreads, buf.problem.NumInstances(), [&](int t, size_t begin, size_t end) {
+			losses[t] += buf.objective.AddInstanceLosses(input, begin, end, *bufs[t]);
+		});
+	};
+
+	if (shards.size() == 1) {
+		if (!resident) {
+			LoadShard(0, *buffers[0]);
+			resident = true;
+		}
+		addShard(*buffers[0]);
+	} else if (shards.size() > 1) {
+		//第一次调用时同步读入第0个分片；之后每次Eval结束前已经开始预读下一次的第0个分片
+		if (!loader.joinable()) StartLoad(0, nextBuffer);
+		int cur = nextBuffer;
+		for (size_t s = 0; s < shards.size(); s++) {
+			WaitLoad();
+			StartLoad((s + 1) % shards.size(), 1 - cur);
+			addShard(*buffers[cur]);
+			cur = 1 - cur;
+		}
+		nextBuffer = cur;
+	}
+
+	if (numThreads > 1) TreeReduce(bufs, input.size(), numThreads);
+	return TreeSum(losses);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <thread>
+
+#include "OWLQN.h"
+#include "logreg.h"
+#include "binaryData.h"
+
+//不把数据集整个读进内存的逻辑回归目标函数
+//数据必须是二进制数据集（mm2bin的输出），按行切成若干分片，每次Eval依次从磁盘读入各个分片并计算
+//两块分片缓冲交替使用：计算当前分片时，后台线程用pread把下一个分片读进另一块缓冲，读盘和计算重叠
+//占用的内存由分片大小（两块缓冲）、参数向量和各线程的梯度缓冲决定，与数据集大小无关
+class StreamingLogisticRegressionObjective : public DifferentiableFunction {
+	//一个分片：第firstRow行开始的numRows行，firstRow是64的倍数，所以分片的label从一个完整的字开始
+	struct Shard {
+		size_t firstRow, numRows;
+		uint64_t firstNonZero, numNonZeros;
+	};
+
+	//分片缓冲：读入的数组，以及指向这些数组的LogisticRegressionProblem
+	struct ShardBuffer {
+		std::vector<uint64_t> rowStarts; //已减去分片的第一个非零元的位置
+		std::vector<uint64_t> indices; //uint32或uint64的下标，用uint64存储保证对齐
+		std::vector<float> values;
+		std::vector<uint64_t> labels;
+		LogisticRegressionProblem problem;
+		LogisticRegressionObjective objective;
+
+		ShardBuffer(size_t numFeats) : problem(numFeats), objective(problem) { }
+	};
+
+	BinaryDataHeader header;
+	BinaryDataReader reader;
+	std::vector<Shard> shards;
+	std::unique_ptr<ShardBuffer> buffers[2];
+	std::thread loader; //正在读入分片的后台线程
+	int nextBuffer; //loader正在读入的缓冲
+	bool resident; //只有一个分片时读入一次之后一直留在内存里
+	const double l2weight;
+	const int numThreads;
+	std::vector<DblVec> threadGrads;
+
+	void SplitShards(uint64_t shardBytes);
+	void LoadShard(size_t s, ShardBuffer& buf);
+	void StartLoad(size_t s, int b);
+	void WaitLoad();
+
+	StreamingLogisticRegressionObjective(const StreamingLogisticRegressionObjective&);
+	StreamingLogisticRegressionObjective& operator=(const StreamingLogisticRegressionObjective&);
+
+public:
+	//shardBytes为一个分片的数组所占字节数的上限（单独一个64行的组超过上限时除外）
+	StreamingLogisticRegressionObjective(const char* filename, double l2weight = 0, int numThreads = 1, uint64_t shardBytes = (uint64_t)256 << 20);
+	~StreamingLogisticRegressionObjective();
+
+	size_t NumFeats() const { return header.numCols; }
+	size_t NumInstances() const { return header.numRows; }
+	size_t NumShards() const { return shards.size(); }
+
+	//与LogisticRegressionObjective::Eval相同，各线程的梯度缓冲在所有分片上累加，最后归约一次
+	double Eval(const DblVec& input, DblVec& gradient);
+};
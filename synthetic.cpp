@@ -0,0 +1,165 @@
+#include "synthetic.h"
+#include "logreg.h"
+#include "leastSquares.h"
+
+#include <algorithm>
+#include <random>
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+void GenerateSynthetic(const SyntheticSpec& spec, bool logistic, SyntheticData& data) {
+	if (spec.rows == 0 || spec.cols == 0 || spec.cols > 0xffffffffu || !(spec.density > 0)) {
+		cerr << "synthetic data needs rows > 0, 0 < cols < 2^32 and density > 0" << endl;
+		exit(1);
+	}
+	data.spec = spec;
+	data.logistic = logistic;
+	data.rowStarts.clear();
+	data.indices.clear();
+	data.values.clear();
+	data.labels.clear();
+
+	mt19937_64 rng(spec.seed), labelRng(spec.seed ^ 0x9e3779b97f4a7c15ull);
+	//正态分布会缓存成对生成的第二个值，label使用自己的分布对象
+	normal_distribution<double> normal, labelNormal;
+	uniform_real_distribution<double> uniform;
+	size_t cols = spec.cols;
+
+	data.trueWeights.assign(cols, 0.0);
+	for (size_t j = 0; j < cols; j++) {
+		if (uniform(rng) < spec.weightDensity) data.trueWeights[j] = normal(rng);
+	}
+
+	//稀疏时：频率排名r的累计概率cdf[r]，以及排名到列号的随机排列
+	vector<double> cdf;
+	vector<uint32_t> colOfRank;
+	size_t perRow = 0;
+	if (!spec.IsDense()) {
+		cdf.resize(cols);
+		double sum = 0;
+		for (size_t r = 0; r < cols; r++) {
+			sum += pow((double)(r + 1), -spec.skew);
+			cdf[r] = sum;
+		}
+		colOfRank.resize(cols);
+		for (size_t j = 0; j < cols; j++) colOfRank[j] = (uint32_t)j;
+		shuffle(colOfRank.begin(), colOfRank.end(), rng);
+		perRow = max((size_t)1, (size_t)llround(spec.density * cols));
+		data.rowStarts.reserve(spec.rows + 1);
+		data.indices.reserve(spec.rows * perRow);
+		data.values.reserve(spec.rows * perRow);
+		data.rowStarts.push_back(0);
+	} else {
+		data.values.reserve(spec.rows * cols);
+	}
+
+	data.labels.resize(spec.rows);
+	vector<uint32_t> rowCols;
+	for (size_t i = 0; i < spec.rows; i++) {
+		double score = 0;
+		if (spec.IsDense()) {
+			for (size_t j = 0; j < cols; j++) {
+				float v = (float)normal(rng);
+				data.values.push_back(v);
+				score += v * data.trueWeights[j];
+			}
+		} else {
+			rowCols.clear();
+			for (size_t k = 0; k < perRow; k++) {
+				size_t r = lower_bound(cdf.begin(), cdf.end(), uniform(rng) * cdf.back()) - cdf.begin();
+				rowCols.push_back(colOfRank[min(r, cols - 1)]);
+			}
+			sort(rowCols.begin(), rowCols.end());
+			rowCols.erase(unique(rowCols.begin(), rowCols.end()), rowCols.end());
+			for (size_t k = 0; k < rowCols.size(); k++) {
+				float v = (float)normal(rng);
+				data.indices.push_back(rowCols[k]);
+				data.values.push_back(v);
+				score += v * data.trueWeights[rowCols[k]];
+			}
+			data.rowStarts.push_back(data.values.size());
+		}
+
+		if (logistic) {
+			data.labels[i] = uniform(labelRng) * (1 + exp(-score)) < 1 ? 1.0f : -1.0f;
+		} else {
+			data.labels[i] = (float)(score + spec.noise * labelNormal(labelRng));
+		}
+	}
+}
+
+void SyntheticData::WriteFeatures(const char* filename) const {
+	ofstream features(filename);
+	if (!features.good()) {
+		cerr << "error opening matrix file " << filename << endl;
+		exit(1);
+	}
+	features.precision(9);
+	if (spec.IsDense()) {
+		//array格式按列存储
+		features << "%%MatrixMarket matrix array real general" << endl;
+		features << spec.rows << " " << spec.cols << endl;
+		for (size_t j = 0; j < spec.cols; j++) {
+			for (size_t i = 0; i < spec.rows; i++) features << values[i * spec.cols + j] << "\n";
+		}
+	} else {
+		features << "%%MatrixMarket matrix coordinate real general" << endl;
+		features << spec.rows << " " << spec.cols << " " << values.size() << endl;
+		for (size_t i = 0; i < spec.rows; i++) {
+			for (uint64_t k = rowStarts[i]; k < rowStarts[i + 1]; k++) {
+				features << i + 1 << " " << indices[k] + 1 << " " << values[k] << "\n";
+			}
+		}
+	}
+}
+
+void SyntheticData::WriteLabels(const char* filename) const {
+	ofstream labelOut(filename);
+	if (!labelOut.good()) {
+		cerr << "error opening label file " << filename << endl;
+		exit(1);
+	}
+	labelOut.precision(9);
+	labelOut << "%%MatrixMarket matrix array real general" << endl;
+	labelOut << spec.rows << " 1" << endl;
+	for (size_t i = 0; i < spec.rows; i++) labelOut << labels[i] << "\n";
+}
+
+LogisticRegressionProblem* MakeLogisticProblem(const SyntheticData& data) {
+	LogisticRegressionProblem* prob = new LogisticRegressionProblem(data.spec.cols);
+	size_t cols = data.spec.cols;
+	vector<size_t> inds;
+	vector<float> vals;
+	for (size_t i = 0; i < data.spec.rows; i++) {
+		bool label = data.labels[i] > 0;
+		if (data.spec.IsDense()) {
+			vals.assign(data.values.begin() + i * cols, data.values.begin() + (i + 1) * cols);
+			prob->AddInstance(vals, label);
+		} else {
+			inds.assign(data.indices.begin() + data.rowStarts[i], data.indices.begin() + data.rowStarts[i + 1]);
+			vals.assign(data.values.begin() + data.rowStarts[i], data.values.begin() + data.rowStarts[i + 1]);
+			prob->AddInstance(inds, vals, label);
+		}
+	}
+	return prob;
+}
+
+LeastSquaresProblem* MakeLeastSquaresProblem(const SyntheticData& data) {
+	size_t rows = data.spec.rows, cols = data.spec.cols;
+	if (!data.spec.IsDense()) {
+		vector<uint64_t> rowStarts(data.rowStarts);
+		vector<uint32_t> indices(data.indices);
+		vector<float> values(data.values), b(data.labels);
+		return new LeastSquaresProblem(cols, rowStarts, indices, values, b);
+	}
+	LeastSquaresProblem* prob = new LeastSquaresProblem(rows, cols);
+	for (size_t i = 0; i < rows; i++) {
+		for (size_t j = 0; j < cols; j++) prob->A(i, j) = data.values[i * cols + j];
+		prob->B(i) = data.labels[i];
+	}
+	return prob;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "OWLQN.h"
+
+class LogisticRegressionProblem;
+class LeastSquaresProblem;
+
+//合成数据集的参数
+struct SyntheticSpec {
+	size_t rows, cols;
+	double density; //每行非零元占cols的比例，不小于1时生成稠密矩阵
+	double skew; //稀疏时特征出现频率的Zipf指数：第r常见的特征的概率正比于1 / (r + 1)^skew，0为均匀
+	double weightDensity; //真实权重中非零的比例
+	double noise; //最小二乘的label噪声的标准差
+	uint64_t seed;
+
+	SyntheticSpec() : rows(10000), cols(1000), density(0.01), skew(0), weightDensity(0.1), noise(0.1), seed(1) { }
+	bool IsDense() const { return density >= 1; }
+};
+
+//生成的数据：样本矩阵（稀疏时为CSR，稠密时按行存储在values中）、label和生成label用的真实权重
+//特征值为标准正态分布；逻辑回归的label以sigmoid(x·w)的概率为1，否则为-1；最小二乘的label为x·w加上正态噪声
+//label用单独的随机数序列，同一个spec生成的逻辑回归和最小二乘数据的样本矩阵和真实权重相同
+struct SyntheticData {
+	SyntheticSpec spec;
+	bool logistic;
+	std::vector<uint64_t> rowStarts;
+	std::vector<uint32_t> indices;
+	std::vector<float> values;
+	std::vector<float> labels;
+	DblVec trueWeights;
+
+	size_t NumNonZeros() const { return values.size(); }
+	//写成MatrixMarket格式的特征文件和label文件，可以直接交给训练程序或mm2bin
+	void WriteFeatures(const char* filename) const;
+	void WriteLabels(const char* filename) const;
+};
+
+//按spec生成数据；稀疏时每行从Zipf分布中有放回地抽取round(density * cols)个特征（至少一个），去掉重复的，所以非零元略少于期望值
+//特征的频率排名到列号是一个随机排列，常见的特征不集中在前几列
+//cols不能超过uint32的范围
+void GenerateSynthetic(const SyntheticSpec& spec, bool logistic, SyntheticData& data);
+
+//由生成的数据构造问题，返回的对象由调用者释放
+LogisticRegressionProblem* MakeLogisticProblem(const SyntheticData& data);
+LeastSquaresProblem* MakeLeastSquaresProblem(const SyntheticData& data);
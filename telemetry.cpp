@@ -0,0 +1,52 @@
+#include "telemetry.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cmath>
+
+using namespace std;
+
+JsonLinesObserver::JsonLinesObserver(const char* filename) : out(filename), run(-1), l1weight(0) {
+	if (!out.good()) {
+		cerr << "error opening telemetry file " << filename << endl;
+		exit(1);
+	}
+}
+
+void JsonLinesObserver::OnStart(size_t, double l1, int) {
+	run++;
+	l1weight = l1;
+}
+
+//JSON中没有NaN和inf，写成null
+static void writeNumber(ostream& out, const char* name, double v) {
+	out << ", \"" << name << "\": ";
+	if (std::isfinite(v)) out << v;
+	else out << "null";
+}
+
+static void writePhase(ostream& out, const char* name, const PhaseStats& p) {
+	out << ", \"" << name << "\": {\"seconds\": " << p.seconds << ", \"calls\": " << p.calls << "}";
+}
+
+void JsonLinesObserver::OnIteration(const IterationStats& s) {
+	out << setprecision(17);
+	out << "{\"run\": " << run << ", \"iter\": " << s.iter << ", \"l1weight\": " << l1weight;
+	writeNumber(out, "value", s.value);
+	writeNumber(out, "conv_crit", s.convCrit);
+	out << ", \"batch\": " << s.batchSize;
+	writeNumber(out, "step", s.step);
+	out << ", \"trials\": " << s.trials;
+	writeNumber(out, "residual", s.residual);
+	out << ", \"nonzeros\": " << s.nonZeros << ", \"active\": " << s.activeCount;
+	out << ", \"bytes\": " << s.bytesTouched;
+	out << setprecision(6) << ", \"seconds\": " << s.seconds;
+	writePhase(out, "update_dir", s.updateDir);
+	writePhase(out, "map_dir", s.mapDir);
+	writePhase(out, "eval", s.eval);
+	writePhase(out, "cached_eval", s.cachedEval);
+	writePhase(out, "line_search", s.lineSearch);
+	writePhase(out, "shift", s.shift);
+	out << "}" << endl;
+}
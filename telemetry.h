@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <fstream>
+
+//一次迭代中一个阶段的累计耗时（秒）和调用次数
+struct PhaseStats {
+	double seconds;
+	int calls;
+
+	PhaseStats() : seconds(0), calls(0) { }
+};
+
+//OWLQN一次迭代的统计，迭代结束（Shift之后，最后一次迭代没有Shift）时交给IterationObserver
+struct IterationStats {
+	int iter;
+	double value; //接受的点处的目标函数值（含l1）
+	double convCrit; //终止条件的值，随机模式下没有判断终止条件时为NaN
+	size_t batchSize; //当前batch的样本数，使用全部样本时为0
+	double step; //接受的步长
+	int trials; //线性查找尝试的步长个数
+	//各阶段：updateDir包含mapDir；lineSearch包含查找中的eval和cachedEval
+	//eval为完整的Eval（或EvalBatch）调用，cachedEval为用线性查找缓存计算的损失和接受步长时补算的梯度
+	PhaseStats updateDir, mapDir, eval, cachedEval, lineSearch, shift;
+	double seconds; //整个迭代的耗时
+	uint64_t bytesTouched; //优化器自己的向量运算读写的字节数（估计值），不含目标函数读取的数据
+	size_t nonZeros; //x中非零的维度数
+	size_t activeCount; //活动维度的个数，不使用active set模式时为dim
+	double residual; //x处虚梯度的2范数，最优解处为0
+
+	explicit IterationStats(int it = 0) : iter(it), value(0), convCrit(0), batchSize(0), step(0), trials(0), seconds(0), bytesTouched(0), nonZeros(0), activeCount(0), residual(0) { }
+};
+
+//stats不为NULL时把作用域内的耗时加到stats上，调用次数加一；为NULL时不读时钟
+class PhaseTimer {
+	PhaseStats* stats;
+	std::chrono::steady_clock::time_point start;
+
+	PhaseTimer(const PhaseTimer&);
+	PhaseTimer& operator=(const PhaseTimer&);
+
+public:
+	explicit PhaseTimer(PhaseStats* stats) : stats(stats) {
+		if (stats != NULL) start = std::chrono::steady_clock::now();
+	}
+
+	~PhaseTimer() {
+		if (stats == NULL) return;
+		stats->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		stats->calls++;
+	}
+};
+
+//接收OWLQN每次迭代的统计；没有设置观察者时Minimize不计时也不统计
+struct IterationObserver {
+	//一次Minimize开始：dim维，l1正则化项的系数为l1weight，记忆m项
+	virtual void OnStart(size_t /*dim*/, double /*l1weight*/, int /*m*/) { }
+	virtual void OnIteration(const IterationStats& stats) = 0;
+	virtual ~IterationObserver() { }
+};
+
+//把每次迭代的统计写成一行JSON，每行写完后刷新，训练中途也可以读取
+//同一个文件中的多次Minimize（例如正则化路径）用run区分
+class JsonLinesObserver : public IterationObserver {
+	std::ofstream out;
+	int run;
+	double l1weight;
+
+	JsonLinesObserver(const JsonLinesObserver&);
+	JsonLinesObserver& operator=(const JsonLinesObserver&);
+
+public:
+	//打开文件失败时输出错误并退出
+	explicit JsonLinesObserver(const char* filename);
+
+	void OnStart(size_t dim, double l1weight, int m);
+	void OnIteration(const IterationStats& stats);
+};
@@ -0,0 +1,632 @@
+#include "vecops.h"
+
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VECOPS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+struct VecKernels {
+	const char* name;
+	double (*dot)(const double*, const double*, size_t);
+	double (*absSum)(const double*, size_t);
+	void (*add)(double*, const double*, size_t);
+	void (*addMult)(double*, const double*, double, size_t);
+	void (*addMultInto)(double*, const double*, const double*, double, size_t);
+	void (*scale)(double*, double, size_t);
+	void (*scaleInto)(double*, const double*, double, size_t);
+	double (*dotFloat)(const float*, const double*, size_t);
+	void (*addMultFloat)(double*, const float*, double, size_t);
+	double (*dotFloats)(const float*, const float*, size_t);
+	void (*subIntoFloat)(float*, const double*, const double*, size_t);
+	double (*logLoss)(const double*, double*, size_t);
+};
+
+//VecLogLoss的常数：exp的自变量在[kExpMin, 0]中，2^k的k不小于-1021，结果总是正规数
+const double kExpMin = -708.0;
+const double kLog2e = 1.4426950408889634;
+const double kLn2Hi = 6.93147180369123816490e-01, kLn2Lo = 1.90821492927058770002e-10; //kLn2Hi的低位为0，k * kLn2Hi是精确的
+const double kLn2 = 0.69314718055994530942;
+const double kSqrt2 = 1.41421356237309504880;
+//exp(r)在|r| <= ln2 / 2上的Taylor系数1/12!, 1/11!, ..., 1/2!，截断误差小于2e-16
+const double kExpCoef[] = {
+	1.0 / 479001600, 1.0 / 39916800, 1.0 / 3628800, 1.0 / 362880, 1.0 / 40320, 1.0 / 5040,
+	1.0 / 720, 1.0 / 120, 1.0 / 24, 1.0 / 6, 1.0 / 2
+};
+//log(m) = 2 * atanh(s) = 2s + 2s * s^2 * (1/3 + s^2/5 + ... + s^16/19)，s = (m - 1) / (m + 1)，|s| <= 0.1716
+const double kLogCoef[] = {
+	1.0 / 19, 1.0 / 17, 1.0 / 15, 1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3
+};
+
+//标量实现：所有CPU都可用
+double dotScalar(const double* a, const double* b, size_t n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += a[i] * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	for (; i < n; i++) s0 += a[i] * b[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+double absSumScalar(const double* a, size_t n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += std::fabs(a[i]);
+		s1 += std::fabs(a[i + 1]);
+		s2 += std::fabs(a[i + 2]);
+		s3 += std::fabs(a[i + 3]);
+	}
+	for (; i < n; i++) s0 += std::fabs(a[i]);
+	return (s0 + s1) + (s2 + s3);
+}
+
+void addScalar(double* a, const double* b, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] += b[i];
+}
+
+void addMultScalar(double* a, const double* b, double c, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] += b[i] * c;
+}
+
+void addMultIntoScalar(double* a, const double* b, const double* c, double d, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] = b[i] + c[i] * d;
+}
+
+void scaleScalar(double* a, double b, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] *= b;
+}
+
+void scaleIntoScalar(double* a, const double* b, double c, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] = b[i] * c;
+}
+
+double dotFloatScalar(const float* a, const double* b, size_t n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += a[i] * b[i];
+		s1 += a[i + 1] * b[i + 1];
+		s2 += a[i + 2] * b[i + 2];
+		s3 += a[i + 3] * b[i + 3];
+	}
+	for (; i < n; i++) s0 += a[i] * b[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+void addMultFloatScalar(double* a, const float* b, double c, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] += b[i] * c;
+}
+
+double dotFloatsScalar(const float* a, const float* b, size_t n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += (double)a[i] * b[i];
+		s1 += (double)a[i + 1] * b[i + 1];
+		s2 += (double)a[i + 2] * b[i + 2];
+		s3 += (double)a[i + 3] * b[i + 3];
+	}
+	for (; i < n; i++) s0 += (double)a[i] * b[i];
+	return (s0 + s1) + (s2 + s3);
+}
+
+void subIntoFloatScalar(float* a, const double* b, const double* c, size_t n) {
+	for (size_t i = 0; i < n; i++) a[i] = (float)(b[i] - c[i]);
+}
+
+//一个margin的损失和mult
+inline double logLossOne(double z, double& mult) {
+	double x = std::max(-std::fabs(z), kExpMin);
+	double k = std::floor(x * kLog2e + 0.5);
+	double r = (x - k * kLn2Hi) - k * kLn2Lo;
+	double p = kExpCoef[0];
+	for (int c = 1; c < 11; c++) p = p * r + kExpCoef[c];
+	p = (p * r + 1.0) * r + 1.0;
+	uint64_t bits = (uint64_t)((int64_t)k + 1023) << 52;
+	double scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	double t = p * scale; //exp(-|z|)
+
+	double u = 1.0 + t;
+	double corr = (t - (u - 1.0)) / u; //log(1 + t) - log(u)
+	bool big = u > kSqrt2;
+	double m = big ? u * 0.5 : u;
+	double s = (m - 1.0) / (m + 1.0), s2 = s * s;
+	double q = kLogCoef[0];
+	for (int c = 1; c < 9; c++) q = q * s2 + kLogCoef[c];
+	double lg = ((big ? kLn2 : 0.0) + (2.0 * s + (2.0 * s * s2) * q)) + corr;
+
+	mult = (z >= 0 ? t : 1.0) / u;
+	return std::max(-z, 0.0) + lg;
+}
+
+double logLossScalar(const double* z, double* mult, size_t n) {
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0, m;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 += logLossOne(z[i], mult ? mult[i] : m);
+		s1 += logLossOne(z[i + 1], mult ? mult[i + 1] : m);
+		s2 += logLossOne(z[i + 2], mult ? mult[i + 2] : m);
+		s3 += logLossOne(z[i + 3], mult ? mult[i + 3] : m);
+	}
+	for (; i < n; i++) s0 += logLossOne(z[i], mult ? mult[i] : m);
+	return (s0 + s1) + (s2 + s3);
+}
+
+const VecKernels scalarKernels = {
+	"scalar", dotScalar, absSumScalar, addScalar, addMultScalar, addMultIntoScalar, scaleScalar, scaleIntoScalar,
+	dotFloatScalar, addMultFloatScalar, dotFloatsScalar, subIntoFloatScalar, logLossScalar
+};
+
+#ifdef VECOPS_X86
+
+//AVX2实现：每次处理4个double，内积和求和用4个累加器
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+AVX2_TARGET double hsum256(__m256d v) {
+	__m128d lo = _mm256_castpd256_pd128(v), hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_add_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+AVX2_TARGET double dotAvx2(const double* a, const double* b, size_t n) {
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4), s1);
+		s2 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 8), _mm256_loadu_pd(b + i + 8), s2);
+		s3 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i + 12), _mm256_loadu_pd(b + i + 12), s3);
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_fmadd_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), s0);
+	}
+	double result = hsum256(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+	for (; i < n; i++) result += a[i] * b[i];
+	return result;
+}
+
+AVX2_TARGET double absSumAvx2(const double* a, size_t n) {
+	const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7FFFFFFFFFFFFFFFLL));
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_add_pd(s0, _mm256_and_pd(_mm256_loadu_pd(a + i), mask));
+		s1 = _mm256_add_pd(s1, _mm256_and_pd(_mm256_loadu_pd(a + i + 4), mask));
+		s2 = _mm256_add_pd(s2, _mm256_and_pd(_mm256_loadu_pd(a + i + 8), mask));
+		s3 = _mm256_add_pd(s3, _mm256_and_pd(_mm256_loadu_pd(a + i + 12), mask));
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_add_pd(s0, _mm256_and_pd(_mm256_loadu_pd(a + i), mask));
+	}
+	double result = hsum256(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+	for (; i < n; i++) result += std::fabs(a[i]);
+	return result;
+}
+
+AVX2_TARGET void addAvx2(double* a, const double* b, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	}
+	for (; i < n; i++) a[i] += b[i];
+}
+
+AVX2_TARGET void addMultAvx2(double* a, const double* b, double c, size_t n) {
+	const __m256d vc = _mm256_set1_pd(c);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_fmadd_pd(_mm256_loadu_pd(b + i), vc, _mm256_loadu_pd(a + i)));
+	}
+	for (; i < n; i++) a[i] += b[i] * c;
+}
+
+AVX2_TARGET void addMultIntoAvx2(double* a, const double* b, const double* c, double d, size_t n) {
+	const __m256d vd = _mm256_set1_pd(d);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_fmadd_pd(_mm256_loadu_pd(c + i), vd, _mm256_loadu_pd(b + i)));
+	}
+	for (; i < n; i++) a[i] = b[i] + c[i] * d;
+}
+
+AVX2_TARGET void scaleAvx2(double* a, double b, size_t n) {
+	const __m256d vb = _mm256_set1_pd(b);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), vb));
+	}
+	for (; i < n; i++) a[i] *= b;
+}
+
+AVX2_TARGET void scaleIntoAvx2(double* a, const double* b, double c, size_t n) {
+	const __m256d vc = _mm256_set1_pd(c);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(b + i), vc));
+	}
+	for (; i < n; i++) a[i] = b[i] * c;
+}
+
+AVX2_TARGET double dotFloatAvx2(const float* a, const double* b, size_t n) {
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_loadu_pd(b + i), s0);
+		s1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)), _mm256_loadu_pd(b + i + 4), s1);
+		s2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 8)), _mm256_loadu_pd(b + i + 8), s2);
+		s3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 12)), _mm256_loadu_pd(b + i + 12), s3);
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_loadu_pd(b + i), s0);
+	}
+	double result = hsum256(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+	for (; i < n; i++) result += a[i] * b[i];
+	return result;
+}
+
+AVX2_TARGET void addMultFloatAvx2(double* a, const float* b, double c, size_t n) {
+	const __m256d vc = _mm256_set1_pd(c);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(a + i, _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(b + i)), vc, _mm256_loadu_pd(a + i)));
+	}
+	for (; i < n; i++) a[i] += b[i] * c;
+}
+
+AVX2_TARGET double dotFloatsAvx2(const float* a, const float* b, size_t n) {
+	__m256d s0 = _mm256_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_cvtps_pd(_mm_loadu_ps(b + i)), s0);
+		s1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4)), s1);
+		s2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 8)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 8)), s2);
+		s3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 12)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 12)), s3);
+	}
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_cvtps_pd(_mm_loadu_ps(b + i)), s0);
+	}
+	double result = hsum256(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+	for (; i < n; i++) result += (double)a[i] * b[i];
+	return result;
+}
+
+AVX2_TARGET void subIntoFloatAvx2(float* a, const double* b, const double* c, size_t n) {
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(a + i, _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(b + i), _mm256_loadu_pd(c + i))));
+	}
+	for (; i < n; i++) a[i] = (float)(b[i] - c[i]);
+}
+
+//与logLossOne相同的运算，每次4个margin；比较和选择用掩码混合代替分支
+//maxpd在有NaN时返回第二个操作数，z放在第二个，NaN与std::max一样传下去
+AVX2_TARGET inline __m256d logLossAvx2Step(__m256d z, __m256d& mult) {
+	const __m256d one = _mm256_set1_pd(1.0), zero = _mm256_setzero_pd();
+	const __m256d signMask = _mm256_set1_pd(-0.0);
+	__m256d x = _mm256_max_pd(_mm256_set1_pd(kExpMin), _mm256_or_pd(z, signMask));
+	__m256d k = _mm256_floor_pd(_mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(kLog2e)), _mm256_set1_pd(0.5)));
+	__m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(k, _mm256_set1_pd(kLn2Hi))), _mm256_mul_pd(k, _mm256_set1_pd(kLn2Lo)));
+	__m256d p = _mm256_set1_pd(kExpCoef[0]);
+	for (int c = 1; c < 11; c++) p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(kExpCoef[c]));
+	p = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(_mm256_mul_pd(p, r), one), r), one);
+	__m256i bits = _mm256_slli_epi64(_mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k)), _mm256_set1_epi64x(1023)), 52);
+	__m256d t = _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+
+	__m256d u = _mm256_add_pd(one, t);
+	__m256d corr = _mm256_div_pd(_mm256_sub_pd(t, _mm256_sub_pd(u, one)), u);
+	__m256d big = _mm256_cmp_pd(u, _mm256_set1_pd(kSqrt2), _CMP_GT_OQ);
+	__m256d m = _mm256_blendv_pd(u, _mm256_mul_pd(u, _mm256_set1_pd(0.5)), big);
+	__m256d s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one)), s2 = _mm256_mul_pd(s, s);
+	__m256d q = _mm256_set1_pd(kLogCoef[0]);
+	for (int c = 1; c < 9; c++) q = _mm256_add_pd(_mm256_mul_pd(q, s2), _mm256_set1_pd(kLogCoef[c]));
+	__m256d two = _mm256_set1_pd(2.0);
+	__m256d lg = _mm256_add_pd(_mm256_mul_pd(two, s), _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(two, s), s2), q));
+	lg = _mm256_add_pd(_mm256_add_pd(_mm256_and_pd(big, _mm256_set1_pd(kLn2)), lg), corr);
+
+	__m256d nonNeg = _mm256_cmp_pd(z, zero, _CMP_GE_OQ);
+	mult = _mm256_div_pd(_mm256_blendv_pd(one, t, nonNeg), u);
+	return _mm256_add_pd(_mm256_max_pd(zero, _mm256_sub_pd(zero, z)), lg);
+}
+
+AVX2_TARGET double logLossAvx2(const double* z, double* mult, size_t n) {
+	__m256d s0 = _mm256_setzero_pd(), m;
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		s0 = _mm256_add_pd(s0, logLossAvx2Step(_mm256_loadu_pd(z + i), m));
+		if (mult) _mm256_storeu_pd(mult + i, m);
+	}
+	if (i < n) {
+		//尾部补0后按向量计算，使每个margin的结果与它的位置无关
+		double zt[4] = { 0, 0, 0, 0 }, mt[4], lt[4];
+		std::copy(z + i, z + n, zt);
+		_mm256_storeu_pd(lt, logLossAvx2Step(_mm256_loadu_pd(zt), m));
+		_mm256_storeu_pd(mt, m);
+		for (size_t j = 0; j < 4; j++) {
+			if (j >= n - i) lt[j] = 0;
+			else if (mult) mult[i + j] = mt[j];
+		}
+		s0 = _mm256_add_pd(s0, _mm256_loadu_pd(lt));
+	}
+	return hsum256(s0);
+}
+
+const VecKernels avx2Kernels = {
+	"avx2", dotAvx2, absSumAvx2, addAvx2, addMultAvx2, addMultIntoAvx2, scaleAvx2, scaleIntoAvx2,
+	dotFloatAvx2, addMultFloatAvx2, dotFloatsAvx2, subIntoFloatAvx2, logLossAvx2
+};
+
+//AVX-512实现：每次处理8个double，尾部用掩码读写
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+AVX512_TARGET inline __mmask8 tailMask(size_t rest) {
+	return (__mmask8)((1u << rest) - 1);
+}
+
+AVX512_TARGET double hsum512(__m512d v) {
+	double t[8];
+	_mm512_storeu_pd(t, v);
+	return ((t[0] + t[1]) + (t[2] + t[3])) + ((t[4] + t[5]) + (t[6] + t[7]));
+}
+
+AVX512_TARGET double dotAvx512(const double* a, const double* b, size_t n) {
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+		s1 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+		s2 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 16), _mm512_loadu_pd(b + i + 16), s2);
+		s3 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i + 24), _mm512_loadu_pd(b + i + 24), s3);
+	}
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm512_fmadd_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i), s0);
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		s1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, a + i), _mm512_maskz_loadu_pd(k, b + i), s1);
+	}
+	return hsum512(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+AVX512_TARGET double absSumAvx512(const double* a, size_t n) {
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_add_pd(s0, _mm512_abs_pd(_mm512_loadu_pd(a + i)));
+		s1 = _mm512_add_pd(s1, _mm512_abs_pd(_mm512_loadu_pd(a + i + 8)));
+		s2 = _mm512_add_pd(s2, _mm512_abs_pd(_mm512_loadu_pd(a + i + 16)));
+		s3 = _mm512_add_pd(s3, _mm512_abs_pd(_mm512_loadu_pd(a + i + 24)));
+	}
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm512_add_pd(s0, _mm512_abs_pd(_mm512_loadu_pd(a + i)));
+	}
+	if (i < n) {
+		s1 = _mm512_add_pd(s1, _mm512_abs_pd(_mm512_maskz_loadu_pd(tailMask(n - i), a + i)));
+	}
+	return hsum512(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+AVX512_TARGET void addAvx512(double* a, const double* b, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_add_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_add_pd(_mm512_maskz_loadu_pd(k, a + i), _mm512_maskz_loadu_pd(k, b + i)));
+	}
+}
+
+AVX512_TARGET void addMultAvx512(double* a, const double* b, double c, size_t n) {
+	const __m512d vc = _mm512_set1_pd(c);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_fmadd_pd(_mm512_loadu_pd(b + i), vc, _mm512_loadu_pd(a + i)));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, b + i), vc, _mm512_maskz_loadu_pd(k, a + i)));
+	}
+}
+
+AVX512_TARGET void addMultIntoAvx512(double* a, const double* b, const double* c, double d, size_t n) {
+	const __m512d vd = _mm512_set1_pd(d);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_fmadd_pd(_mm512_loadu_pd(c + i), vd, _mm512_loadu_pd(b + i)));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_fmadd_pd(_mm512_maskz_loadu_pd(k, c + i), vd, _mm512_maskz_loadu_pd(k, b + i)));
+	}
+}
+
+AVX512_TARGET void scaleAvx512(double* a, double b, size_t n) {
+	const __m512d vb = _mm512_set1_pd(b);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_mul_pd(_mm512_loadu_pd(a + i), vb));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_mul_pd(_mm512_maskz_loadu_pd(k, a + i), vb));
+	}
+}
+
+AVX512_TARGET void scaleIntoAvx512(double* a, const double* b, double c, size_t n) {
+	const __m512d vc = _mm512_set1_pd(c);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_mul_pd(_mm512_loadu_pd(b + i), vc));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_mul_pd(_mm512_maskz_loadu_pd(k, b + i), vc));
+	}
+}
+
+//读入8个float并转成double；用带掩码的转换，避免GCC对_mm512_cvtps_pd误报未初始化
+AVX512_TARGET inline __m512d loadFloats(const float* a) {
+	return _mm512_maskz_cvtps_pd((__mmask8)0xFF, _mm256_loadu_ps(a));
+}
+
+//尾部不足8个时先拷到补零的数组里
+AVX512_TARGET inline __m512d loadFloatsTail(const float* a, size_t rest) {
+	float t[8] = { 0 };
+	for (size_t i = 0; i < rest; i++) t[i] = a[i];
+	return loadFloats(t);
+}
+
+AVX512_TARGET double dotFloatAvx512(const float* a, const double* b, size_t n) {
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_fmadd_pd(loadFloats(a + i), _mm512_loadu_pd(b + i), s0);
+		s1 = _mm512_fmadd_pd(loadFloats(a + i + 8), _mm512_loadu_pd(b + i + 8), s1);
+		s2 = _mm512_fmadd_pd(loadFloats(a + i + 16), _mm512_loadu_pd(b + i + 16), s2);
+		s3 = _mm512_fmadd_pd(loadFloats(a + i + 24), _mm512_loadu_pd(b + i + 24), s3);
+	}
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm512_fmadd_pd(loadFloats(a + i), _mm512_loadu_pd(b + i), s0);
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		s1 = _mm512_fmadd_pd(loadFloatsTail(a + i, n - i), _mm512_maskz_loadu_pd(k, b + i), s1);
+	}
+	return hsum512(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+AVX512_TARGET void addMultFloatAvx512(double* a, const float* b, double c, size_t n) {
+	const __m512d vc = _mm512_set1_pd(c);
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm512_storeu_pd(a + i, _mm512_fmadd_pd(loadFloats(b + i), vc, _mm512_loadu_pd(a + i)));
+	}
+	if (i < n) {
+		__mmask8 k = tailMask(n - i);
+		_mm512_mask_storeu_pd(a + i, k, _mm512_fmadd_pd(loadFloatsTail(b + i, n - i), vc, _mm512_maskz_loadu_pd(k, a + i)));
+	}
+}
+
+AVX512_TARGET double dotFloatsAvx512(const float* a, const float* b, size_t n) {
+	__m512d s0 = _mm512_setzero_pd(), s1 = s0, s2 = s0, s3 = s0;
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		s0 = _mm512_fmadd_pd(loadFloats(a + i), loadFloats(b + i), s0);
+		s1 = _mm512_fmadd_pd(loadFloats(a + i + 8), loadFloats(b + i + 8), s1);
+		s2 = _mm512_fmadd_pd(loadFloats(a + i + 16), loadFloats(b + i + 16), s2);
+		s3 = _mm512_fmadd_pd(loadFloats(a + i + 24), loadFloats(b + i + 24), s3);
+	}
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm512_fmadd_pd(loadFloats(a + i), loadFloats(b + i), s0);
+	}
+	if (i < n) {
+		s1 = _mm512_fmadd_pd(loadFloatsTail(a + i, n - i), loadFloatsTail(b + i, n - i), s1);
+	}
+	return hsum512(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+}
+
+//写float的尾部需要AVX-512VL的掩码存储，这里用标量处理；转换同loadFloats用带掩码的形式
+AVX512_TARGET void subIntoFloatAvx512(float* a, const double* b, const double* c, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(a + i, _mm512_maskz_cvtpd_ps((__mmask8)0xFF, _mm512_sub_pd(_mm512_loadu_pd(b + i), _mm512_loadu_pd(c + i))));
+	}
+	for (; i < n; i++) a[i] = (float)(b[i] - c[i]);
+}
+
+//与logLossOne相同的运算，每次8个margin；尾部用掩码读写
+//max、取整、转换和移位同loadFloats用全掩码的形式，避免GCC误报未初始化；max的操作数顺序同AVX2，传递NaN
+AVX512_TARGET inline __m512d logLossAvx512Step(__m512d z, __m512d& mult) {
+	const __m512d one = _mm512_set1_pd(1.0), zero = _mm512_setzero_pd();
+	const __mmask8 all = 0xFF;
+	__m512d x = _mm512_maskz_max_pd(all, _mm512_set1_pd(kExpMin), _mm512_sub_pd(zero, _mm512_abs_pd(z)));
+	__m512d k = _mm512_maskz_roundscale_pd(all, _mm512_add_pd(_mm512_mul_pd(x, _mm512_set1_pd(kLog2e)), _mm512_set1_pd(0.5)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+	__m512d r = _mm512_sub_pd(_mm512_sub_pd(x, _mm512_mul_pd(k, _mm512_set1_pd(kLn2Hi))), _mm512_mul_pd(k, _mm512_set1_pd(kLn2Lo)));
+	__m512d p = _mm512_set1_pd(kExpCoef[0]);
+	for (int c = 1; c < 11; c++) p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(kExpCoef[c]));
+	p = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(_mm512_mul_pd(p, r), one), r), one);
+	__m256i k32 = _mm512_maskz_cvtpd_epi32(all, k);
+	__m512i bits = _mm512_maskz_slli_epi64(all, _mm512_add_epi64(_mm512_maskz_cvtepi32_epi64(all, k32), _mm512_set1_epi64(1023)), 52);
+	__m512d t = _mm512_mul_pd(p, _mm512_castsi512_pd(bits));
+
+	__m512d u = _mm512_add_pd(one, t);
+	__m512d corr = _mm512_div_pd(_mm512_sub_pd(t, _mm512_sub_pd(u, one)), u);
+	__mmask8 big = _mm512_cmp_pd_mask(u, _mm512_set1_pd(kSqrt2), _CMP_GT_OQ);
+	__m512d m = _mm512_mask_mul_pd(u, big, u, _mm512_set1_pd(0.5));
+	__m512d s = _mm512_div_pd(_mm512_sub_pd(m, one), _mm512_add_pd(m, one)), s2 = _mm512_mul_pd(s, s);
+	__m512d q = _mm512_set1_pd(kLogCoef[0]);
+	for (int c = 1; c < 9; c++) q = _mm512_add_pd(_mm512_mul_pd(q, s2), _mm512_set1_pd(kLogCoef[c]));
+	__m512d two = _mm512_set1_pd(2.0);
+	__m512d lg = _mm512_add_pd(_mm512_mul_pd(two, s), _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(two, s), s2), q));
+	lg = _mm512_add_pd(_mm512_add_pd(_mm512_maskz_mov_pd(big, _mm512_set1_pd(kLn2)), lg), corr);
+
+	__mmask8 nonNeg = _mm512_cmp_pd_mask(z, zero, _CMP_GE_OQ);
+	mult = _mm512_div_pd(_mm512_mask_mov_pd(one, nonNeg, t), u);
+	return _mm512_add_pd(_mm512_maskz_max_pd(all, zero, _mm512_sub_pd(zero, z)), lg);
+}
+
+AVX512_TARGET double logLossAvx512(const double* z, double* mult, size_t n) {
+	__m512d s0 = _mm512_setzero_pd(), m;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		s0 = _mm512_add_pd(s0, logLossAvx512Step(_mm512_loadu_pd(z + i), m));
+		if (mult) _mm512_storeu_pd(mult + i, m);
+	}
+	if (i < n) {
+		__mmask8 mask = tailMask(n - i);
+		//掩码外的元素取0，损失为log 2，不加到结果里
+		s0 = _mm512_mask_add_pd(s0, mask, s0, logLossAvx512Step(_mm512_maskz_loadu_pd(mask, z + i), m));
+		if (mult) _mm512_mask_storeu_pd(mult + i, mask, m);
+	}
+	return hsum512(s0);
+}
+
+const VecKernels avx512Kernels = {
+	"avx512", dotAvx512, absSumAvx512, addAvx512, addMultAvx512, addMultIntoAvx512, scaleAvx512, scaleIntoAvx512,
+	dotFloatAvx512, addMultFloatAvx512, dotFloatsAvx512, subIntoFloatAvx512, logLossAvx512
+};
+
+#endif
+
+//按CPU支持的指令集选择实现
+const VecKernels& selectKernels() {
+#ifdef VECOPS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return avx512Kernels;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return avx2Kernels;
+#endif
+	return scalarKernels;
+}
+
+const VecKernels& kernels() {
+	static const VecKernels& k = selectKernels();
+	return k;
+}
+
+}
+
+double VecDot(const double* a, const double* b, size_t n) { return kernels().dot(a, b, n); }
+double VecAbsSum(const double* a, size_t n) { return kernels().absSum(a, n); }
+void VecAdd(double* a, const double* b, size_t n) { kernels().add(a, b, n); }
+void VecAddMult(double* a, const double* b, double c, size_t n) { kernels().addMult(a, b, c, n); }
+void VecAddMultInto(double* a, const double* b, const double* c, double d, size_t n) { kernels().addMultInto(a, b, c, d, n); }
+void VecScale(double* a, double b, size_t n) { kernels().scale(a, b, n); }
+void VecScaleInto(double* a, const double* b, double c, size_t n) { kernels().scaleInto(a, b, c, n); }
+double VecDotFloat(const float* a, const double* b, size_t n) { return kernels().dotFloat(a, b, n); }
+void VecAddMultFloat(double* a, const float* b, double c, size_t n) { kernels().addMultFloat(a, b, c, n); }
+double VecDotFloats(const float* a, const float* b, size_t n) { return kernels().dotFloats(a, b, n); }
+void VecSubIntoFloat(float* a, const double* b, const double* c, size_t n) { kernels().subIntoFloat(a, b, c, n); }
+double VecLogLoss(const double* z, double* mult, size_t n) { return kernels().logLoss(z, mult, n); }
+const char* VecIsaName() { return kernels().name; }
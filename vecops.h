@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+//稠密向量运算的核函数，供OptimizerState中的向量运算使用
+//第一次调用时按CPU支持的指令集选择AVX-512、AVX2或标量实现，之后一直使用同一个实现
+//内积和求和使用多个累加器，避免每次加法都等待上一次加法的结果
+
+double VecDot(const double* a, const double* b, size_t n); //返回a·b
+double VecAbsSum(const double* a, size_t n); //返回sum(|a[i]|)
+void VecAdd(double* a, const double* b, size_t n); //a += b
+void VecAddMult(double* a, const double* b, double c, size_t n); //a += b * c
+void VecAddMultInto(double* a, const double* b, const double* c, double d, size_t n); //a = b + c * d
+void VecScale(double* a, double b, size_t n); //a *= b
+void VecScaleInto(double* a, const double* b, double c, size_t n); //a = b * c
+
+//float与double混合的版本，用于按float存储的样本矩阵和记忆项，在double中累加
+double VecDotFloat(const float* a, const double* b, size_t n); //返回a·b
+void VecAddMultFloat(double* a, const float* b, double c, size_t n); //a += b * c
+double VecDotFloats(const float* a, const float* b, size_t n); //返回a·b
+void VecSubIntoFloat(float* a, const double* b, const double* c, size_t n); //a = b - c，结果舍入为float
+
+//逻辑回归的损失：z[k]为第k个样本乘以label后的margin，返回sum(log(1 + exp(-z[k])))，
+//mult不为NULL时mult[k] = 1 / (1 + exp(z[k]))，即1减去分类正确的概率（梯度的系数）
+//不分支、不调用libm：t = exp(-|z|)用2^k乘以12次Taylor多项式，log(1 + t)用atanh级数并修正1 + t的舍入误差
+//|z| <= 708时损失和mult的相对误差都小于6e-16，约3个ulp（与long double的expl、log1pl比较）
+//同一指令集下每个margin的结果与它在数组中的位置无关；各指令集之间可能相差末位（向量实现中乘加会合并为FMA）
+//|z| > 708时exp(-|z|)按exp(-708)计算，绝对误差小于1e-307
+//z为NaN时损失和mult都是NaN，各指令集相同
+double VecLogLoss(const double* z, double* mult, size_t n);
+
+//当前使用的指令集："avx512"、"avx2"或"scalar"
+const char* VecIsaName();